@@ -0,0 +1,259 @@
+ 
+/**
+ * @file hot_key_detector.cpp
+ * @author way
+ * @date 2026/10/18 10:40:21
+ * @brief
+ *
+ **/
+
+#include "hot_key_detector.h"
+
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <algorithm>
+#include <new>
+
+#include "glog/logging.h"
+#include "time_util.h"
+
+namespace tis {
+
+static bool hot_key_greater(const HotKey& a, const HotKey& b) {
+    return a.qps > b.qps;
+}
+
+HotKeyDetector::HotKeyDetector() {
+    _sample_rate = DEFAULT_SAMPLE_RATE;
+    _top_k = DEFAULT_TOP_K;
+    _sketch_width = DEFAULT_SKETCH_WIDTH;
+    _sketch_depth = DEFAULT_SKETCH_DEPTH;
+    _window_us = DEFAULT_WINDOW_SEC * 1000000ULL;
+    _window_start_us = monotonic_time_us();
+    pthread_mutex_init(&_mutex, NULL);
+}
+
+HotKeyDetector::~HotKeyDetector() {
+    __free_trackers();
+    pthread_mutex_destroy(&_mutex);
+}
+
+int HotKeyDetector::init(uint32_t sample_rate,
+                        uint32_t top_k,
+                        uint32_t sketch_width,
+                        uint32_t sketch_depth,
+                        uint32_t window_sec) {
+    if (0 == sample_rate || 0 == top_k || 0 == sketch_width || 0 == sketch_depth
+            || top_k > MAX_TOP_K || sketch_width > MAX_SKETCH_WIDTH
+            || sketch_depth > MAX_SKETCH_DEPTH) {
+        LOG(WARNING) << "hot key detector: illegal param, sample_rate[" << sample_rate
+            << "] top_k[" << top_k << "] width[" << sketch_width
+            << "] depth[" << sketch_depth << "]";
+        return 1;
+    }
+    // width is used as a mask, MAX_SKETCH_WIDTH is a power of 2
+    uint32_t width = 1;
+    while (width < sketch_width) {
+        width <<= 1;
+    }
+    pthread_mutex_lock(&_mutex);
+    __free_trackers();
+    _sample_rate = sample_rate;
+    _top_k = top_k;
+    _sketch_width = width;
+    _sketch_depth = sketch_depth;
+    _window_us = window_sec * 1000000ULL;
+    _window_start_us = monotonic_time_us();
+    pthread_mutex_unlock(&_mutex);
+    return 0;
+}
+
+uint64_t HotKeyDetector::hash_key(const char* key, size_t len) {
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= static_cast<unsigned char>(key[i]);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+void HotKeyDetector::__free_trackers() {
+    for (size_t i = 0; i < _trackers.size(); ++i) {
+        delete [] _trackers[i]->sketch;
+        delete [] _trackers[i]->slots;
+        delete _trackers[i];
+    }
+    _trackers.clear();
+}
+
+HotKeyDetector::Tracker* HotKeyDetector::__get_tracker(const char* host,
+                                                    uint32_t port,
+                                                    const char* command) {
+    for (size_t i = 0; i < _trackers.size(); ++i) {
+        Tracker* tracker = _trackers[i];
+        if (port == tracker->port
+                && 0 == strcmp(command, tracker->command)
+                && tracker->host == host) {
+            return tracker;
+        }
+    }
+    Tracker* tracker = new(std::nothrow) Tracker;
+    if (NULL == tracker) {
+        return NULL;
+    }
+    size_t cell_num = static_cast<size_t>(_sketch_width) * _sketch_depth;
+    tracker->sketch = new(std::nothrow) uint32_t[cell_num];
+    tracker->slots = new(std::nothrow) Slot[_top_k];
+    if (NULL == tracker->sketch || NULL == tracker->slots) {
+        LOG(WARNING) << "hot key detector: alloc tracker failed, command[" << command << "]";
+        delete [] tracker->sketch;
+        delete [] tracker->slots;
+        delete tracker;
+        return NULL;
+    }
+    memset(tracker->sketch, 0, sizeof(uint32_t) * cell_num);
+    tracker->host = host;
+    tracker->port = port;
+    snprintf(tracker->command, sizeof(tracker->command), "%s", command);
+    tracker->used = 0;
+    _trackers.push_back(tracker);
+    return tracker;
+}
+
+void HotKeyDetector::record(const char* host,
+                        uint32_t port,
+                        const char* command,
+                        const char* key,
+                        uint64_t bytes) {
+    if (NULL == host || NULL == command || NULL == key) {
+        return;
+    }
+    size_t key_len = strlen(key);
+    uint64_t hash = hash_key(key, key_len);
+
+    pthread_mutex_lock(&_mutex);
+    __rotate_window(monotonic_time_us());
+    Tracker* tracker = __get_tracker(host, port, command);
+    if (NULL == tracker) {
+        pthread_mutex_unlock(&_mutex);
+        return;
+    }
+
+    uint32_t estimate = UINT32_MAX;
+    for (uint32_t row = 0; row < _sketch_depth; ++row) {
+        // independent index per row, murmur3 finalizer over a row seed
+        uint64_t h = hash ^ ((row + 1) * 0x9E3779B97F4A7C15ULL);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        size_t index = static_cast<size_t>(row) * _sketch_width + (h & (_sketch_width - 1));
+        uint32_t& cell = tracker->sketch[index];
+        if (UINT32_MAX != cell) {
+            ++cell;
+        }
+        estimate = std::min(estimate, cell);
+    }
+
+    Slot* min_slot = NULL;
+    for (uint32_t i = 0; i < tracker->used; ++i) {
+        Slot* slot = &tracker->slots[i];
+        if (hash == slot->hash) {
+            ++slot->count;
+            ++slot->hits;
+            slot->bytes += bytes;
+            pthread_mutex_unlock(&_mutex);
+            return;
+        }
+        if (NULL == min_slot || slot->count < min_slot->count) {
+            min_slot = slot;
+        }
+    }
+
+    // space-saving admission, but only evict when the sketch says the new key is hotter
+    Slot* slot = NULL;
+    if (tracker->used < _top_k) {
+        slot = &tracker->slots[tracker->used++];
+    } else if (estimate > min_slot->count) {
+        slot = min_slot;
+    }
+    if (NULL != slot) {
+        // only the hits seen since admission are exact
+        slot->hash = hash;
+        slot->count = estimate;
+        slot->error = estimate - 1;
+        slot->hits = 1;
+        slot->bytes = bytes;
+        slot->key_len = std::min(key_len, static_cast<size_t>(MAX_KEY_LEN));
+        memcpy(slot->key, key, slot->key_len);
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+int HotKeyDetector::get_top_keys(std::vector<HotKey>* keys,
+                            const char* command,
+                            uint32_t limit) {
+    if (NULL == keys) {
+        return 1;
+    }
+    keys->clear();
+    pthread_mutex_lock(&_mutex);
+    uint64_t now = monotonic_time_us();
+    __rotate_window(now);
+    double elapsed = (now - _window_start_us) / 1000000.0;
+    if (elapsed < 0.001) {
+        elapsed = 0.001;
+    }
+    for (size_t i = 0; i < _trackers.size(); ++i) {
+        const Tracker* tracker = _trackers[i];
+        if (NULL != command && 0 != strcasecmp(command, tracker->command)) {
+            continue;
+        }
+        char endpoint[256];
+        snprintf(endpoint, sizeof(endpoint), "%s:%u", tracker->host.c_str(), tracker->port);
+        for (uint32_t j = 0; j < tracker->used; ++j) {
+            const Slot& slot = tracker->slots[j];
+            HotKey hot_key;
+            hot_key.endpoint = endpoint;
+            hot_key.command = tracker->command;
+            hot_key.key.assign(slot.key, slot.key_len);
+            hot_key.count = slot.count * _sample_rate;
+            hot_key.error = slot.error * _sample_rate;
+            hot_key.qps = hot_key.count / elapsed;
+            hot_key.bytes_per_sec = hot_key.qps * slot.bytes / slot.hits;
+            keys->push_back(hot_key);
+        }
+    }
+    pthread_mutex_unlock(&_mutex);
+    std::sort(keys->begin(), keys->end(), hot_key_greater);
+    if (0 != limit && keys->size() > limit) {
+        keys->resize(limit);
+    }
+    return 0;
+}
+
+void HotKeyDetector::reset() {
+    pthread_mutex_lock(&_mutex);
+    __reset_window(monotonic_time_us());
+    pthread_mutex_unlock(&_mutex);
+}
+
+void HotKeyDetector::__reset_window(uint64_t now) {
+    size_t cell_num = static_cast<size_t>(_sketch_width) * _sketch_depth;
+    for (size_t i = 0; i < _trackers.size(); ++i) {
+        memset(_trackers[i]->sketch, 0, sizeof(uint32_t) * cell_num);
+        _trackers[i]->used = 0;
+    }
+    _window_start_us = now;
+}
+
+void HotKeyDetector::__rotate_window(uint64_t now) {
+    if (0 != _window_us && now - _window_start_us >= _window_us) {
+        __reset_window(now);
+    }
+}
+
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
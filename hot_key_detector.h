@@ -0,0 +1,121 @@
+ 
+/**
+ * @file hot_key_detector.h
+ * @author way
+ * @date 2026/10/18 10:12:05
+ * @brief sampled hot key detection: count-min sketch + space-saving top-K
+ *        per (endpoint, command)
+ *
+ **/
+
+#ifndef  __HOT_KEY_DETECTOR_H_
+#define  __HOT_KEY_DETECTOR_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace tis {
+
+struct HotKey {
+    std::string endpoint;       // host:port
+    std::string command;
+    std::string key;            // truncated to HotKeyDetector::MAX_KEY_LEN
+    uint64_t count;             // estimated ops in the current window, sample rate applied
+    uint64_t error;             // count - error is a guaranteed lower bound
+    double qps;
+    double bytes_per_sec;       // request value + reply payload
+};
+
+/*
+ * Shared by any number of RedisProxy instances (see RedisProxy::set_hot_key_detector).
+ * Each proxy samples 1 of every sample_rate commands and hands it to record(), so the
+ * unsampled path is a single counter decrement. All memory of a (endpoint, command)
+ * tracker is allocated the first time that pair is seen, never per key.
+ *
+ * Counts cover a tumbling window of window_sec seconds that starts over by itself, so a
+ * key that stopped being hot drops out after at most one window. window_sec 0 keeps
+ * counting until reset() is called.
+ */
+class HotKeyDetector {
+public:
+    static const uint32_t DEFAULT_SAMPLE_RATE = 64;
+    static const uint32_t DEFAULT_TOP_K = 32;
+    static const uint32_t DEFAULT_SKETCH_WIDTH = 2048;
+    static const uint32_t DEFAULT_SKETCH_DEPTH = 4;
+    static const uint32_t DEFAULT_WINDOW_SEC = 60;
+    static const uint32_t MAX_TOP_K = 4096;
+    static const uint32_t MAX_SKETCH_WIDTH = 1 << 24;
+    static const uint32_t MAX_SKETCH_DEPTH = 16;
+    static const uint32_t MAX_KEY_LEN = 64;
+    static const uint32_t MAX_COMMAND_LEN = 24;
+public:
+    HotKeyDetector();
+    virtual ~HotKeyDetector();
+    int init(uint32_t sample_rate = DEFAULT_SAMPLE_RATE,
+                uint32_t top_k = DEFAULT_TOP_K,
+                uint32_t sketch_width = DEFAULT_SKETCH_WIDTH,
+                uint32_t sketch_depth = DEFAULT_SKETCH_DEPTH,
+                uint32_t window_sec = DEFAULT_WINDOW_SEC);
+    uint32_t get_sample_rate() const { return _sample_rate; }
+    void record(const char* host,
+                uint32_t port,
+                const char* command,
+                const char* key,
+                uint64_t bytes);
+    // merged over all trackers, sorted by qps desc; command == NULL means any.
+    // keys is cleared first
+    int get_top_keys(std::vector<HotKey>* keys,
+                const char* command = NULL,
+                uint32_t limit = 0);
+    // start a new window
+    void reset();
+
+    static uint64_t hash_key(const char* key, size_t len);
+
+private:
+    struct Slot {
+        uint64_t hash;
+        uint64_t count;
+        uint64_t error;
+        uint64_t hits;
+        uint64_t bytes;
+        uint32_t key_len;
+        char key[MAX_KEY_LEN];
+    };
+
+    struct Tracker {
+        std::string host;
+        uint32_t port;
+        char command[MAX_COMMAND_LEN];
+        uint32_t* sketch;
+        Slot* slots;
+        uint32_t used;
+    };
+
+    Tracker* __get_tracker(const char* host, uint32_t port, const char* command);
+    void __free_trackers();
+    // called with _mutex held
+    void __reset_window(uint64_t now);
+    void __rotate_window(uint64_t now);
+
+    uint32_t _sample_rate;
+    uint32_t _top_k;
+    uint32_t _sketch_width;
+    uint32_t _sketch_depth;
+    uint64_t _window_us;
+    uint64_t _window_start_us;
+
+    pthread_mutex_t _mutex;
+    std::vector<Tracker*> _trackers;
+
+    HotKeyDetector(const HotKeyDetector&);
+    HotKeyDetector& operator=(const HotKeyDetector&);
+};
+
+}
+
+#endif  //__HOT_KEY_DETECTOR_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
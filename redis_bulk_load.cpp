@@ -0,0 +1,85 @@
+ 
+/**
+ * @file redis_bulk_load.cpp
+ * @author way
+ * @date 2026/10/18 21:36:27
+ * @brief loads a tab separated command file through RedisBulkLoader
+ *
+ * ./redis_bulk_load --input_file=./keys.tsv --host=127.0.0.1 --port=6379 --window=20000
+ **/
+
+#include <stdio.h>
+#include <string>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "redis_bulk_loader.h"
+#include "redis_proxy.h"
+
+DEFINE_string(input_file, "./input.tsv", "commands to load, in the given format");
+DEFINE_string(format, "tsv", "tsv: one command per line, fields separated by tab, "
+        "\\t \\n \\r \\\\ escaped; resp: redis protocol, sent as is");
+DEFINE_string(host, "127.0.0.1", "redis host");
+DEFINE_int32(port, 6379, "redis port");
+DEFINE_int32(window, 10000, "max unacknowledged commands");
+DEFINE_int32(buffer_size, 1024 * 1024, "bytes encoded before they are sent");
+DEFINE_int32(report_interval, 10, "seconds between throughput logs, 0 disables");
+DEFINE_int32(timeout_ms, 10000, "redis timeout in milliseconds");
+
+namespace {
+
+class PrintErrorHandler : public tis::BulkLoadHandler {
+public:
+    virtual void on_error(uint64_t line_no, const std::string& msg) {
+        fprintf(stderr, "line[%llu] %s\n", static_cast<unsigned long long>(line_no), msg.c_str());
+    }
+};
+
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    if (FLAGS_window <= 0 || FLAGS_buffer_size <= 0 || FLAGS_report_interval < 0) {
+        fprintf(stderr, "illegal window, buffer_size or report_interval\n");
+        return 1;
+    }
+    if ("tsv" != FLAGS_format && "resp" != FLAGS_format) {
+        fprintf(stderr, "illegal format[%s]\n", FLAGS_format.c_str());
+        return 1;
+    }
+    tis::RedisProxy proxy;
+    proxy.set_timeout(FLAGS_timeout_ms);
+    if (0 != proxy.connect(FLAGS_host.c_str(), FLAGS_port)) {
+        fprintf(stderr, "connect failed, host[%s] port[%d]\n", FLAGS_host.c_str(), FLAGS_port);
+        return 1;
+    }
+    PrintErrorHandler handler;
+    tis::RedisBulkLoader loader;
+    loader.set_format("resp" == FLAGS_format ? tis::RedisBulkLoader::FORMAT_RESP
+                                             : tis::RedisBulkLoader::FORMAT_TSV);
+    loader.set_window(FLAGS_window);
+    loader.set_buffer_size(FLAGS_buffer_size);
+    loader.set_report_interval(FLAGS_report_interval);
+    loader.set_handler(&handler);
+    int ret = loader.load(&proxy, FLAGS_input_file.c_str());
+
+    const tis::BulkLoadStats& stats = loader.get_stats();
+    double elapsed = stats.elapsed_us / 1000000.0;
+    if (elapsed < 0.001) {
+        elapsed = 0.001;
+    }
+    printf("file[%s] ret[%d] records[%llu] ok[%llu] err[%llu] malformed[%llu]\n",
+            FLAGS_input_file.c_str(),
+            ret,
+            static_cast<unsigned long long>(stats.record_num),
+            static_cast<unsigned long long>(stats.ok_num),
+            static_cast<unsigned long long>(stats.err_num),
+            static_cast<unsigned long long>(stats.malformed_num));
+    printf("elapsed[%.3fs] records/s[%.0f] MB/s[%.2f]\n",
+            elapsed,
+            stats.record_num / elapsed,
+            stats.bytes / elapsed / 1048576);
+    return (0 == ret && 0 == stats.err_num && 0 == stats.malformed_num) ? 0 : 1;
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
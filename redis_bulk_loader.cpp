@@ -0,0 +1,397 @@
+ 
+/**
+ * @file redis_bulk_loader.cpp
+ * @author way
+ * @date 2026/10/18 20:47:10
+ * @brief
+ *
+ **/
+
+#include "redis_bulk_loader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hiredis.h"
+#include "glog/logging.h"
+#include "redis_proxy.h"
+#include "time_util.h"
+
+namespace tis {
+
+static const uint64_t MAX_LOGGED_ERRORS = 100;
+
+// the character a TSV escape stands for, 0 for an illegal one
+static char unescape(char c) {
+    switch (c) {
+    case 't':
+        return '\t';
+    case 'n':
+        return '\n';
+    case 'r':
+        return '\r';
+    case '\\':
+        return '\\';
+    default:
+        return 0;
+    }
+}
+
+static void append_uint(std::string* buffer, uint64_t value) {
+    char digits[20];
+    int len = 0;
+    do {
+        digits[len++] = '0' + value % 10;
+        value /= 10;
+    } while (0 != value);
+    while (len > 0) {
+        buffer->push_back(digits[--len]);
+    }
+}
+
+RedisBulkLoader::RedisBulkLoader() {
+    _format = FORMAT_TSV;
+    _window = DEFAULT_WINDOW;
+    _buffer_size = DEFAULT_BUFFER_SIZE;
+    _report_interval = DEFAULT_REPORT_INTERVAL;
+    _handler = NULL;
+    _redis_proxy = NULL;
+    _span = NULL;
+    _span_end = NULL;
+    _encoded_num = 0;
+    _sent_num = 0;
+    _acked_num = 0;
+    _start_us = 0;
+    _last_report_us = 0;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+RedisBulkLoader::~RedisBulkLoader() {
+}
+
+void RedisBulkLoader::set_format(int format) {
+    _format = (FORMAT_RESP == format) ? FORMAT_RESP : FORMAT_TSV;
+}
+
+void RedisBulkLoader::set_window(uint32_t window) {
+    _window = (0 == window) ? 1 : window;
+}
+
+void RedisBulkLoader::set_buffer_size(uint32_t buffer_size) {
+    _buffer_size = buffer_size;
+}
+
+void RedisBulkLoader::set_report_interval(uint32_t report_interval) {
+    _report_interval = report_interval;
+}
+
+void RedisBulkLoader::set_handler(BulkLoadHandler* handler) {
+    _handler = handler;
+}
+
+int RedisBulkLoader::load(RedisProxy* proxy, const char* path) {
+    if (NULL == proxy || NULL == path) {
+        LOG(WARNING) << "redis bulk loader: illegal param";
+        return 1;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        LOG(WARNING) << "redis bulk loader: open failed, path[" << path
+            << "] errno[" << errno << "]";
+        return 1;
+    }
+    struct stat st;
+    if (0 != fstat(fd, &st)) {
+        LOG(WARNING) << "redis bulk loader: stat failed, path[" << path
+            << "] errno[" << errno << "]";
+        close(fd);
+        return 1;
+    }
+    size_t size = st.st_size;
+    void* addr = NULL;
+    if (size > 0) {
+        addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED == addr) {
+            LOG(WARNING) << "redis bulk loader: mmap failed, path[" << path
+                << "] errno[" << errno << "]";
+            close(fd);
+            return 1;
+        }
+        madvise(addr, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    _redis_proxy = proxy;
+    _buffer.clear();
+    _buffer.reserve(_buffer_size + 4096);
+    _line_nos.assign(_window, 0);
+    _encoded_num = 0;
+    _sent_num = 0;
+    _acked_num = 0;
+    memset(&_stats, 0, sizeof(_stats));
+    _start_us = monotonic_time_us();
+    _last_report_us = _start_us;
+
+    int ret = __load(static_cast<const char*>(addr), size);
+
+    _stats.elapsed_us = monotonic_time_us() - _start_us;
+    __report_progress(true);
+    if (NULL != addr) {
+        munmap(addr, size);
+    }
+    _redis_proxy = NULL;
+    _span = NULL;
+    _span_end = NULL;
+    return ret;
+}
+
+int RedisBulkLoader::__load(const char* data, size_t size) {
+    int ret = (FORMAT_RESP == _format) ? __load_resp(data, size) : __load_tsv(data, size);
+    if (0 != __send()) {
+        return 1;
+    }
+    while (_acked_num < _sent_num) {
+        if (0 != __read_replies(true)) {
+            return 1;
+        }
+    }
+    return ret;
+}
+
+int RedisBulkLoader::__load_tsv(const char* data, size_t size) {
+    uint64_t line_no = 0;
+    const char* end = data + size;
+    const char* line = data;
+    while (line < end) {
+        const char* eol = static_cast<const char*>(memchr(line, '\n', end - line));
+        if (NULL == eol) {
+            eol = end;
+        }
+        size_t len = eol - line;
+        if (len > 0 && '\r' == line[len - 1]) {
+            --len;
+        }
+        ++line_no;
+        if (len > 0) {
+            if ('\t' == line[0]) {
+                ++_stats.malformed_num;
+                __report_error(line_no, "malformed record, empty command");
+            } else {
+                if (0 != __make_room()) {
+                    return 1;
+                }
+                _line_nos[_encoded_num % _window] = line_no;
+                if (0 != __encode(line, len)) {
+                    ++_stats.malformed_num;
+                    __report_error(line_no, "malformed record, illegal escape");
+                } else if (_buffer.size() >= _buffer_size
+                        && (0 != __send() || 0 != __read_replies(false))) {
+                    return 1;
+                }
+            }
+        }
+        line = eol + 1;
+        if (0 == (line_no & 4095)) {
+            __report_progress(false);
+        }
+    }
+    return 0;
+}
+
+int RedisBulkLoader::__load_resp(const char* data, size_t size) {
+    // commands are only framed, the bytes are sent from the mapping as they are
+    uint64_t command_no = 0;
+    const char* end = data + size;
+    const char* p = data;
+    _span = data;
+    _span_end = data;
+    while (p < end) {
+        RespCommand command;
+        int ret = RedisProxy::parse_command(p, end - p, &command);
+        if (RedisProxy::REDIS_PARSE_OK != ret) {
+            // nothing after it can be framed, what was framed before still goes out
+            ++_stats.malformed_num;
+            __report_error(command_no + 1, (RedisProxy::REDIS_PARSE_INCOMPLETE == ret)
+                    ? "malformed command, truncated at the end of the file"
+                    : "malformed command, the rest of the file is not loaded");
+            return 1;
+        }
+        if (0 != __make_room()) {
+            return 1;
+        }
+        ++command_no;
+        _line_nos[_encoded_num % _window] = command_no;
+        ++_encoded_num;
+        p += command.size;
+        _span_end = p;
+        if (static_cast<size_t>(_span_end - _span) >= _buffer_size
+                && (0 != __send() || 0 != __read_replies(false))) {
+            return 1;
+        }
+        if (0 == (command_no & 4095)) {
+            __report_progress(false);
+        }
+    }
+    return 0;
+}
+
+int RedisBulkLoader::__make_room() {
+    if (_encoded_num - _acked_num < _window) {
+        return 0;
+    }
+    // window is full, the collected commands must go out before their replies can come back
+    return (0 != __send() || 0 != __read_replies(true)) ? 1 : 0;
+}
+
+int RedisBulkLoader::__encode(const char* line, size_t len) {
+    // first pass checks the escapes and sizes the fields, as the lengths go first
+    _field_lens.clear();
+    size_t field_len = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if ('\t' == line[i]) {
+            _field_lens.push_back(field_len);
+            field_len = 0;
+            continue;
+        }
+        if ('\\' == line[i]) {
+            if (i + 1 == len || 0 == unescape(line[i + 1])) {
+                return 1;
+            }
+            ++i;
+        }
+        ++field_len;
+    }
+    _field_lens.push_back(field_len);
+
+    _buffer.push_back('*');
+    append_uint(&_buffer, _field_lens.size());
+    _buffer.append("\r\n", 2);
+    const char* p = line;
+    const char* end = line + len;
+    for (size_t i = 0; i < _field_lens.size(); ++i) {
+        _buffer.push_back('$');
+        append_uint(&_buffer, _field_lens[i]);
+        _buffer.append("\r\n", 2);
+        while (p < end && '\t' != *p) {
+            const char* run = p;
+            while (p < end && '\t' != *p && '\\' != *p) {
+                ++p;
+            }
+            _buffer.append(run, p - run);
+            if (p < end && '\\' == *p) {
+                _buffer.push_back(unescape(p[1]));
+                p += 2;
+            }
+        }
+        _buffer.append("\r\n", 2);
+        ++p;
+    }
+    ++_encoded_num;
+    return 0;
+}
+
+int RedisBulkLoader::__send() {
+    const char* data = _buffer.data();
+    size_t len = _buffer.size();
+    if (FORMAT_RESP == _format) {
+        data = _span;
+        len = _span_end - _span;
+    }
+    if (0 == len) {
+        return 0;
+    }
+    if (RedisProxy::REDIS_RETURN_OK != _redis_proxy->write_formatted_command(data, len)) {
+        LOG(WARNING) << "redis bulk loader: send failed, sent[" << _sent_num << "]";
+        return 1;
+    }
+    _stats.bytes += len;
+    _buffer.clear();
+    _span = _span_end;
+    _sent_num = _encoded_num;
+    _stats.record_num = _sent_num;
+    return 0;
+}
+
+int RedisBulkLoader::__read_replies(bool block) {
+    // when blocking, wait until the window has room again, or everything is acked
+    uint64_t target = _sent_num;
+    if (block && _sent_num > _acked_num + _window / 2) {
+        target = _sent_num - _window / 2;
+    }
+    while (_acked_num < _sent_num) {
+        redisReply* reply = NULL;
+        int ret = 0;
+        if (block && _acked_num < target) {
+            // error replies go to __report_error, which rate limits them
+            ret = _redis_proxy->get_reply(&reply, false);
+        } else {
+            ret = _redis_proxy->try_get_reply(&reply);
+        }
+        if (RedisProxy::REDIS_REQUEST_ERR == ret) {
+            LOG(WARNING) << "redis bulk loader: read reply failed, acked[" << _acked_num
+                << "] sent[" << _sent_num << "]";
+            return 1;
+        }
+        if (NULL == reply) {
+            break;
+        }
+        __handle_reply(reply, ret);
+        freeReplyObject(reply);
+    }
+    return 0;
+}
+
+void RedisBulkLoader::__handle_reply(const redisReply* reply, int ret) {
+    uint64_t line_no = _line_nos[_acked_num % _window];
+    ++_acked_num;
+    if (RedisProxy::REDIS_RETURN_ERR == ret) {
+        ++_stats.err_num;
+        __report_error(line_no, std::string(reply->str, reply->len));
+    } else {
+        ++_stats.ok_num;
+    }
+}
+
+void RedisBulkLoader::__report_error(uint64_t line_no, const std::string& msg) {
+    if (NULL != _handler) {
+        _handler->on_error(line_no, msg);
+        return;
+    }
+    uint64_t error_num = _stats.err_num + _stats.malformed_num;
+    if (error_num <= MAX_LOGGED_ERRORS) {
+        LOG(WARNING) << "redis bulk loader: line[" << line_no << "] msg[" << msg << "]";
+    }
+    if (MAX_LOGGED_ERRORS == error_num) {
+        LOG(WARNING) << "redis bulk loader: too many errors, only counted from now on";
+    }
+}
+
+void RedisBulkLoader::__report_progress(bool force) {
+    if (0 == _report_interval && !force) {
+        return;
+    }
+    uint64_t now = monotonic_time_us();
+    if (!force && now - _last_report_us < _report_interval * 1000000ULL) {
+        return;
+    }
+    _last_report_us = now;
+    double elapsed = (now - _start_us) / 1000000.0;
+    if (elapsed < 0.001) {
+        elapsed = 0.001;
+    }
+    LOG(INFO) << "redis bulk loader: records[" << _stats.record_num
+        << "] ok[" << _stats.ok_num
+        << "] err[" << _stats.err_num
+        << "] malformed[" << _stats.malformed_num
+        << "] in_flight[" << _sent_num - _acked_num
+        << "] records/s[" << static_cast<uint64_t>(_stats.record_num / elapsed)
+        << "] MB/s[" << _stats.bytes / elapsed / 1048576 << "]";
+}
+
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,128 @@
+ 
+/**
+ * @file redis_bulk_loader.h
+ * @author way
+ * @date 2026/10/18 20:14:52
+ * @brief mass load, streams records of a memory mapped file to redis as raw RESP with a
+ *        bounded window of unacknowledged commands, like redis-cli --pipe
+ *
+ **/
+
+#ifndef  __REDIS_BULK_LOADER_H_
+#define  __REDIS_BULK_LOADER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct redisReply;
+
+namespace tis {
+
+class RedisProxy;
+
+struct BulkLoadStats {
+    uint64_t record_num;        // sent commands
+    uint64_t ok_num;
+    uint64_t err_num;           // error replies
+    uint64_t malformed_num;     // lines that could not be turned into a command
+    uint64_t bytes;             // RESP bytes sent
+    uint64_t elapsed_us;
+};
+
+class BulkLoadHandler {
+public:
+    virtual ~BulkLoadHandler() {}
+    // line_no is 1 based, for RESP input it is the number of the command
+    virtual void on_error(uint64_t line_no, const std::string& msg) = 0;
+};
+
+/*
+ * Two input formats:
+ *
+ * FORMAT_RESP holds the commands in RESP, as fed to redis-cli --pipe. Only the command
+ * boundaries are parsed and the bytes go to the socket straight from the mapping, so
+ * values can hold anything. A truncated or malformed command ends the load, since
+ * nothing after it can be framed; the commands before it are still sent.
+ *
+ * FORMAT_TSV holds one command per line, fields separated by '\t', e.g.
+ *     SET<TAB>key<TAB>value
+ *     ZADD<TAB>key<TAB>1.5<TAB>member
+ * with '\t', '\n', '\r' and '\\' inside a field written as \t, \n, \r and \\. A line
+ * with any other backslash sequence is counted as malformed and skipped. Empty lines are
+ * skipped, a trailing '\r' is taken as part of a CRLF line end.
+ *
+ * Commands are collected up to buffer_size bytes (encoded into a write buffer for TSV)
+ * and then written to the socket of the proxy without another copy. Replies are picked
+ * up whenever they have arrived, and the loader only waits for them when window
+ * commands are in flight. Error replies are reported to the handler (or logged) and
+ * loading goes on.
+ */
+class RedisBulkLoader {
+public:
+    static const uint32_t DEFAULT_WINDOW = 10000;
+    static const uint32_t DEFAULT_BUFFER_SIZE = 1024 * 1024;
+    static const uint32_t DEFAULT_REPORT_INTERVAL = 10;
+
+    static const int FORMAT_TSV = 0;
+    static const int FORMAT_RESP = 1;
+public:
+    RedisBulkLoader();
+    virtual ~RedisBulkLoader();
+    void set_format(int format);
+    void set_window(uint32_t window);
+    void set_buffer_size(uint32_t buffer_size);
+    // seconds between throughput logs, 0 disables
+    void set_report_interval(uint32_t report_interval);
+    // not owned, NULL logs the errors
+    void set_handler(BulkLoadHandler* handler);
+    // the proxy must be connected and not used by anyone else until load returns;
+    // returns 0 when the whole file went through, error replies included
+    int load(RedisProxy* proxy, const char* path);
+    const BulkLoadStats& get_stats() const { return _stats; }
+
+private:
+    int __load(const char* data, size_t size);
+    int __load_tsv(const char* data, size_t size);
+    int __load_resp(const char* data, size_t size);
+    // sends and waits for replies while window commands are in flight
+    int __make_room();
+    // 1 if the line is malformed, nothing is encoded then
+    int __encode(const char* line, size_t len);
+    int __send();
+    int __read_replies(bool block);
+    void __handle_reply(const redisReply* reply, int ret);
+    void __report_error(uint64_t line_no, const std::string& msg);
+    void __report_progress(bool force);
+
+    int _format;
+    uint32_t _window;
+    uint32_t _buffer_size;
+    uint32_t _report_interval;
+    BulkLoadHandler* _handler;
+
+    RedisProxy* _redis_proxy;
+    std::string _buffer;
+    std::vector<size_t> _field_lens;
+    // RESP input: commands of the mapping not sent yet
+    const char* _span;
+    const char* _span_end;
+    // line number of every in flight command, indexed by sequence % window
+    std::vector<uint64_t> _line_nos;
+    uint64_t _encoded_num;      // TSV lines encoded or RESP commands framed
+    uint64_t _sent_num;
+    uint64_t _acked_num;
+    uint64_t _start_us;
+    uint64_t _last_report_us;
+    BulkLoadStats _stats;
+
+    RedisBulkLoader(const RedisBulkLoader&);
+    RedisBulkLoader& operator=(const RedisBulkLoader&);
+};
+
+}
+
+#endif  //__REDIS_BULK_LOADER_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
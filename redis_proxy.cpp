@@ -9,7 +9,17 @@
 
 #include "redis_proxy.h"
 
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <algorithm>
+
 #include "hiredis.h"
+#include "hot_key_detector.h"
+#include "time_util.h"
+#include "traffic_recorder.h"
 #include "glog/logging.h"
 
 namespace tis {
@@ -22,6 +32,10 @@ RedisProxy::RedisProxy() {
     _redis_context = NULL;
     _redis_reply = NULL;
     _last_err =  REDIS_OK;
+    _hot_key_detector = NULL;
+    _sample_countdown = 0;
+    _traffic_recorder = NULL;
+    memset(_command_cache, 0, sizeof(_command_cache));
 }
 
 RedisProxy::~RedisProxy() {
@@ -36,6 +50,15 @@ void RedisProxy::set_timeout(long timeout) {
     _timeout = timeout;
 }
 
+void RedisProxy::set_hot_key_detector(HotKeyDetector* detector) {
+    _hot_key_detector = detector;
+    _sample_countdown = (NULL == detector) ? 0 : detector->get_sample_rate();
+}
+
+void RedisProxy::set_traffic_recorder(TrafficRecorder* recorder) {
+    _traffic_recorder = recorder;
+}
+
 RedisProxy* RedisProxy::duplicate() const {
     RedisProxy* new_proxy = new(std::nothrow) RedisProxy;
     if (NULL == new_proxy) {
@@ -43,6 +66,8 @@ RedisProxy* RedisProxy::duplicate() const {
     }
     new_proxy->set_retry_num(get_retry_num());
     new_proxy->set_timeout(get_timeout());
+    new_proxy->set_hot_key_detector(get_hot_key_detector());
+    new_proxy->set_traffic_recorder(get_traffic_recorder());
     int ret = new_proxy->connect(get_host(), get_port());
     if (0 != ret) {
         delete new_proxy;
@@ -95,15 +120,234 @@ int RedisProxy::connect(const char* host, uint32_t port) {
     return 0;
 }
 
-int RedisProxy::__execute_command(const char* fmt, ...) {
-    for (uint32_t i = 0; i < _retry_num + 1; ++i) {
-        if (REDIS_ERR_IO == _last_err 
-                || REDIS_ERR_EOF == _last_err) {
-            close_connection(); 
-            if (connect(_host, _port)) {
-                return REDIS_REQUEST_ERR;
+// first word of the format, upper cased
+static void get_command_name(const char* fmt, char* buf, size_t size) {
+    size_t i = 0;
+    for (; i + 1 < size && '\0' != fmt[i] && ' ' != fmt[i]; ++i) {
+        buf[i] = toupper(fmt[i]);
+    }
+    buf[i] = '\0';
+}
+
+static uint64_t get_reply_size(const redisReply* reply) {
+    if (REDIS_REPLY_ARRAY == reply->type) {
+        uint64_t size = 0;
+        for (size_t i = 0; i < reply->elements; ++i) {
+            size += get_reply_size(reply->element[i]);
+        }
+        return size;
+    }
+    if (REDIS_REPLY_STRING == reply->type) {
+        return reply->len;
+    }
+    return 0;
+}
+
+const RedisProxy::CommandInfo* RedisProxy::__get_command_info(const char* fmt) {
+    // direct mapped on the address of the format
+    uint64_t h = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(fmt)) * 0x9E3779B97F4A7C15ULL;
+    CommandInfo* info = &_command_cache[h >> (64 - COMMAND_CACHE_BITS)];
+    if (fmt != info->fmt) {
+        get_command_name(fmt, info->name, sizeof(info->name));
+        info->code = TrafficRecorder::command_code(info->name, strlen(info->name));
+        info->fmt = fmt;
+    }
+    return info;
+}
+
+int RedisProxy::__check_connection() {
+    if (REDIS_ERR_IO == _last_err 
+            || REDIS_ERR_EOF == _last_err) {
+        close_connection(); 
+        if (connect(_host, _port)) {
+            return 1;
+        }
+        _last_err = REDIS_OK;
+    }
+    return 0;
+}
+
+bool RedisProxy::__sample_command() {
+    if (NULL != _hot_key_detector && 0 == --_sample_countdown) {
+        _sample_countdown = _hot_key_detector->get_sample_rate();
+        return true;
+    }
+    return false;
+}
+
+static int parse_number(const char* buf, const char* end, const char** next, int64_t* value) {
+    const char* p = buf;
+    int64_t v = 0;
+    for (; p < end && isdigit(*p); ++p) {
+        if (p - buf >= 18) {
+            return RedisProxy::REDIS_PARSE_ERR;
+        }
+        v = v * 10 + (*p - '0');
+    }
+    if (p == end) {
+        return RedisProxy::REDIS_PARSE_INCOMPLETE;
+    }
+    if (p == buf || '\r' != p[0]) {
+        return RedisProxy::REDIS_PARSE_ERR;
+    }
+    if (p + 1 == end) {
+        return RedisProxy::REDIS_PARSE_INCOMPLETE;
+    }
+    if ('\n' != p[1]) {
+        return RedisProxy::REDIS_PARSE_ERR;
+    }
+    *next = p + 2;
+    *value = v;
+    return RedisProxy::REDIS_PARSE_OK;
+}
+
+int RedisProxy::parse_command(const char* buf, size_t len, RespCommand* command) {
+    // the limits of redis itself
+    static const int64_t MAX_ARG_NUM = INT32_MAX;
+    static const int64_t MAX_ARG_LEN = 512LL * 1024 * 1024;
+    if (NULL == buf || NULL == command) {
+        return REDIS_PARSE_ERR;
+    }
+    if (0 == len) {
+        return REDIS_PARSE_INCOMPLETE;
+    }
+    if ('*' != buf[0]) {
+        return REDIS_PARSE_ERR;
+    }
+    const char* end = buf + len;
+    const char* p = NULL;
+    int64_t arg_num = 0;
+    int ret = parse_number(buf + 1, end, &p, &arg_num);
+    if (REDIS_PARSE_OK != ret) {
+        return ret;
+    }
+    if (arg_num <= 0 || arg_num > MAX_ARG_NUM) {
+        return REDIS_PARSE_ERR;
+    }
+    memset(command, 0, sizeof(*command));
+    command->arg_num = arg_num;
+    for (int64_t i = 0; i < arg_num; ++i) {
+        if (p == end) {
+            return REDIS_PARSE_INCOMPLETE;
+        }
+        if ('$' != p[0]) {
+            return REDIS_PARSE_ERR;
+        }
+        int64_t arg_len = 0;
+        ret = parse_number(p + 1, end, &p, &arg_len);
+        if (REDIS_PARSE_OK != ret) {
+            return ret;
+        }
+        if (arg_len > MAX_ARG_LEN) {
+            return REDIS_PARSE_ERR;
+        }
+        if (end - p < arg_len + 2) {
+            return REDIS_PARSE_INCOMPLETE;
+        }
+        if ('\r' != p[arg_len] || '\n' != p[arg_len + 1]) {
+            return REDIS_PARSE_ERR;
+        }
+        if (0 == i) {
+            command->name = p;
+            command->name_len = arg_len;
+        } else if (1 == i) {
+            command->key = p;
+            command->key_len = arg_len;
+        } else {
+            command->value_size += arg_len;
+        }
+        p += arg_len + 2;
+    }
+    command->size = p - buf;
+    return REDIS_PARSE_OK;
+}
+
+void RedisProxy::__trace_append(const char* cmd, size_t len) {
+    uint64_t start_us = 0;
+    uint64_t start_mono_us = 0;
+    if (NULL != _traffic_recorder) {
+        start_us = wall_time_us();
+        start_mono_us = monotonic_time_us();
+    }
+    RespCommand command;
+    while (len > 0 && REDIS_PARSE_OK == parse_command(cmd, len, &command)) {
+        cmd += command.size;
+        len -= command.size;
+        // one entry per command, even if only the sampler wants some of them, so replies
+        // are matched up by position
+        bool sampled = __sample_command() && NULL != command.key;
+        _pending_commands.push_back(PendingCommand());
+        PendingCommand& pending = _pending_commands.back();
+        pending.code = TrafficRecorder::command_code(command.name, command.name_len);
+        pending.sampled = sampled;
+        pending.has_key = (NULL != command.key);
+        pending.value_size = std::min(command.value_size, static_cast<uint64_t>(UINT32_MAX));
+        pending.start_us = start_us;
+        pending.start_mono_us = start_mono_us;
+        if (sampled) {
+            size_t name_len = std::min(command.name_len,
+                                    static_cast<size_t>(MAX_COMMAND_NAME_LEN - 1));
+            for (size_t i = 0; i < name_len; ++i) {
+                pending.name.push_back(toupper(command.name[i]));
             }
         }
+        if (pending.has_key && (sampled || NULL != _traffic_recorder)) {
+            pending.key.assign(command.key, command.key_len);
+        }
+    }
+}
+
+void RedisProxy::__trace_reply(const redisReply* reply, int result) {
+    // commands appended before tracing was turned on have no entry
+    if (_pending_commands.empty()) {
+        return;
+    }
+    const PendingCommand& pending = _pending_commands.front();
+    const char* key = pending.has_key ? pending.key.c_str() : NULL;
+    if (NULL != _traffic_recorder) {
+        _traffic_recorder->record(pending.code,
+                                  key,
+                                  pending.value_size,
+                                  pending.start_us,
+                                  monotonic_time_us() - pending.start_mono_us,
+                                  result);
+    }
+    if (pending.sampled && NULL != _hot_key_detector && NULL != reply) {
+        _hot_key_detector->record(_host,
+                                  _port,
+                                  pending.name.c_str(),
+                                  key,
+                                  pending.value_size + get_reply_size(reply));
+    }
+    _pending_commands.pop_front();
+}
+
+void RedisProxy::__trace_drop() {
+    while (!_pending_commands.empty()) {
+        __trace_reply(NULL, REDIS_REQUEST_ERR);
+    }
+}
+
+int RedisProxy::__execute_command(const char* key, uint32_t value_size, const char* fmt, ...) {
+    bool sampled = __sample_command() && NULL != key;
+    // the trace keeps the wall clock start, latency comes from the monotonic clock so a
+    // clock step during the command can not turn it into garbage
+    uint64_t start_us = 0;
+    uint64_t start_mono_us = 0;
+    if (NULL != _traffic_recorder) {
+        start_us = wall_time_us();
+        start_mono_us = monotonic_time_us();
+    }
+    const CommandInfo* command = NULL;
+    if (sampled || NULL != _traffic_recorder) {
+        command = __get_command_info(fmt);
+    }
+    int ret = REDIS_REQUEST_ERR;
+    _redis_reply = NULL;
+    for (uint32_t i = 0; i < _retry_num + 1; ++i) {
+        if (__check_connection()) {
+            break;
+        }
         va_list args;
         va_start(args, fmt);
         _redis_reply = static_cast<redisReply*>(redisvCommand(_redis_context, fmt, args));
@@ -115,18 +359,187 @@ int RedisProxy::__execute_command(const char* fmt, ...) {
         } else {
             _last_err = REDIS_OK; 
         }
+        if (sampled) {
+            _hot_key_detector->record(_host, 
+                                      _port, 
+                                      command->name, 
+                                      key, 
+                                      value_size + get_reply_size(_redis_reply));
+        }
         if (REDIS_REPLY_ERROR == _redis_reply->type) {
             LOG(WARNING) << "redis proxy: return erro, msg[" << _redis_reply->str << "]";
-            return REDIS_RETURN_ERR; 
+            ret = REDIS_RETURN_ERR; 
+        } else {
+            ret = REDIS_RETURN_OK;
+        }
+        break;
+    }
+    if (NULL != _traffic_recorder) {
+        _traffic_recorder->record(command->code, 
+                                  key, 
+                                  value_size, 
+                                  start_us, 
+                                  monotonic_time_us() - start_mono_us, 
+                                  ret);
+    }
+    return ret; 
+}
+
+int RedisProxy::append_command(const char* fmt, ...) {
+    if (__check_connection() || NULL == _redis_context) {
+        return REDIS_REQUEST_ERR;
+    }
+    va_list args;
+    va_start(args, fmt);
+    int ret = REDIS_OK;
+    if (NULL == _traffic_recorder && NULL == _hot_key_detector) {
+        ret = redisvAppendCommand(_redis_context, fmt, args);
+    } else {
+        // formatted here so that the trace sees the same bytes as the server
+        char* cmd = NULL;
+        int len = redisvFormatCommand(&cmd, fmt, args);
+        if (len < 0) {
+            va_end(args);
+            LOG(WARNING) << "redis proxy: format command failed, fmt[" << fmt << "]";
+            return REDIS_REQUEST_ERR;
+        }
+        ret = redisAppendFormattedCommand(_redis_context, cmd, len);
+        if (REDIS_OK == ret) {
+            __trace_append(cmd, len);
+        }
+        redisFreeCommand(cmd);
+    }
+    va_end(args);
+    if (REDIS_OK != ret) {
+        LOG(WARNING) << "redis proxy: append command failed, msg[" << __get_err_msg() << "]";
+        return REDIS_REQUEST_ERR;
+    }
+    return REDIS_RETURN_OK;
+}
+
+int RedisProxy::append_formatted_command(const char* cmd, size_t len) {
+    if (__check_connection() || NULL == _redis_context) {
+        return REDIS_REQUEST_ERR;
+    }
+    if (REDIS_OK != redisAppendFormattedCommand(_redis_context, cmd, len)) {
+        LOG(WARNING) << "redis proxy: append formatted command failed, msg["
+            << __get_err_msg() << "]";
+        return REDIS_REQUEST_ERR;
+    }
+    if (NULL != _traffic_recorder || NULL != _hot_key_detector) {
+        __trace_append(cmd, len);
+    }
+    return REDIS_RETURN_OK;
+}
+
+int RedisProxy::write_formatted_command(const char* cmd, size_t len) {
+    if (__check_connection() || NULL == _redis_context) {
+        return REDIS_REQUEST_ERR;
+    }
+    // whatever was appended before has to go first
+    if (REDIS_RETURN_OK != flush_commands()) {
+        return REDIS_REQUEST_ERR;
+    }
+    size_t written = 0;
+    while (written < len) {
+        ssize_t n = send(_redis_context->fd, cmd + written, len - written, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            // reconnect on the next command, like a failed read
+            _last_err = REDIS_ERR_IO;
+            LOG(WARNING) << "redis proxy: write commands failed, errno[" << errno
+                << "] written[" << written << "] len[" << len << "]";
+            return REDIS_REQUEST_ERR;
+        }
+        written += n;
+    }
+    if (NULL != _traffic_recorder || NULL != _hot_key_detector) {
+        __trace_append(cmd, len);
+    }
+    return REDIS_RETURN_OK;
+}
+
+int RedisProxy::flush_commands() {
+    if (NULL == _redis_context) {
+        return REDIS_REQUEST_ERR;
+    }
+    int done = 0;
+    do {
+        if (REDIS_OK != redisBufferWrite(_redis_context, &done)) {
+            _last_err = _redis_context->err;
+            LOG(WARNING) << "redis proxy: flush commands failed, msg[" << __get_err_msg() << "]";
+            return REDIS_REQUEST_ERR;
+        }
+    } while (!done);
+    return REDIS_RETURN_OK;
+}
+
+int RedisProxy::get_reply(redisReply** reply, bool log_error) {
+    if (NULL == reply || NULL == _redis_context) {
+        return REDIS_REQUEST_ERR;
+    }
+    *reply = NULL;
+    void* r = NULL;
+    if (REDIS_OK != redisGetReply(_redis_context, &r)) {
+        _last_err = _redis_context->err;
+        LOG(WARNING) << "redis proxy: get pipelined reply failed, msg[" << __get_err_msg() << "]";
+        __trace_drop();
+        return REDIS_REQUEST_ERR;
+    }
+    *reply = static_cast<redisReply*>(r);
+    int ret = REDIS_RETURN_OK;
+    if (REDIS_REPLY_ERROR == (*reply)->type) {
+        if (log_error) {
+            LOG(WARNING) << "redis proxy: return erro, msg[" << (*reply)->str << "]";
         }
-        return REDIS_RETURN_OK;
+        ret = REDIS_RETURN_ERR;
     }
-    return REDIS_REQUEST_ERR; 
+    __trace_reply(*reply, ret);
+    return ret;
+}
+
+int RedisProxy::try_get_reply(redisReply** reply) {
+    if (NULL == reply || NULL == _redis_context) {
+        return REDIS_REQUEST_ERR;
+    }
+    *reply = NULL;
+    void* r = NULL;
+    if (REDIS_OK != redisGetReplyFromReader(_redis_context, &r)) {
+        _last_err = _redis_context->err;
+        LOG(WARNING) << "redis proxy: parse reply failed, msg[" << __get_err_msg() << "]";
+        __trace_drop();
+        return REDIS_REQUEST_ERR;
+    }
+    if (NULL == r) {
+        struct pollfd pfd;
+        pfd.fd = _redis_context->fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, 0) <= 0) {
+            return REDIS_RETURN_OK;
+        }
+        if (REDIS_OK != redisBufferRead(_redis_context)
+                || REDIS_OK != redisGetReplyFromReader(_redis_context, &r)) {
+            _last_err = _redis_context->err;
+            LOG(WARNING) << "redis proxy: read reply failed, msg[" << __get_err_msg() << "]";
+            __trace_drop();
+            return REDIS_REQUEST_ERR;
+        }
+        if (NULL == r) {
+            return REDIS_RETURN_OK;
+        }
+    }
+    *reply = static_cast<redisReply*>(r);
+    int ret = (REDIS_REPLY_ERROR == (*reply)->type) ? REDIS_RETURN_ERR : REDIS_RETURN_OK;
+    __trace_reply(*reply, ret);
+    return ret;
 }
 
 bool RedisProxy::is_alive() {
     bool ret = false;
-    if(REDIS_RETURN_OK == __execute_command("PING")
+    if(REDIS_RETURN_OK == __execute_command(NULL, 0, "PING")
             && REDIS_REPLY_STATUS == _redis_reply->type
             && 0 == strcasecmp(_redis_reply->str, "PONG")) {
         ret = true;
@@ -150,6 +563,7 @@ int RedisProxy::shutdown() {
 }
 
 void RedisProxy::close_connection() {
+    __trace_drop();
     if(NULL != _redis_context) {
         redisFree(_redis_context);
         _redis_context = NULL;
@@ -158,7 +572,7 @@ void RedisProxy::close_connection() {
 
 int RedisProxy::set(const char* key, const char* value, uint32_t size) {
     int ret = -1;
-    if (REDIS_RETURN_OK == __execute_command("SET %s %b", key, value, size)
+    if (REDIS_RETURN_OK == __execute_command(key, size, "SET %s %b", key, value, size)
             && REDIS_REPLY_STATUS == _redis_reply->type
             && 0 == strcasecmp(_redis_reply->str, "OK")) {
         ret = REDIS_SET_OK;
@@ -171,7 +585,7 @@ int RedisProxy::set(const char* key, const char* value, uint32_t size) {
 
 int RedisProxy::get(const char* key, std::string& value) {
     int ret = -1;
-    if (REDIS_RETURN_OK == __execute_command("GET %s", key)) {
+    if (REDIS_RETURN_OK == __execute_command(key, 0, "GET %s", key)) {
         if (REDIS_REPLY_NIL == _redis_reply->type) {
             ret = REDIS_GET_NOT_EXIST; 
         }
@@ -188,7 +602,7 @@ int RedisProxy::get(const char* key, std::string& value) {
 
 int RedisProxy::del(const char* key) {
     int ret = -1;
-    if (REDIS_RETURN_OK == __execute_command("DEL %s", key)) {
+    if (REDIS_RETURN_OK == __execute_command(key, 0, "DEL %s", key)) {
         if (REDIS_REPLY_INTEGER == _redis_reply->type) {
             if (0 == _redis_reply->integer) {
                 ret = REDIS_DEL_NOT_EXIST; 
@@ -206,7 +620,7 @@ int RedisProxy::del(const char* key) {
 
 int RedisProxy::exists(const char* key) {
     int ret = REDIS_EXISTS_ERR;
-    if (REDIS_RETURN_OK == __execute_command("exists %s", key)) {
+    if (REDIS_RETURN_OK == __execute_command(key, 0, "exists %s", key)) {
         if (REDIS_REPLY_INTEGER == _redis_reply->type) {
             if (0 == _redis_reply->integer) {
                 ret = REDIS_EXISTS_NO; 
@@ -224,11 +638,11 @@ int RedisProxy::exists(const char* key) {
 
 int RedisProxy::setex(const char* key, const char* value, uint32_t size, uint64_t expire_time) {
     int ret = -1;
-    if (REDIS_RETURN_OK == __execute_command("SETEX %s %llu %b", 
-                                             key, 
-                                             expire_time, 
-                                             value, 
-                                             size)
+    if (REDIS_RETURN_OK == __execute_command(key, size, "SETEX %s %llu %b", 
+                                                       key, 
+                                                       expire_time, 
+                                                       value, 
+                                                       size)
             && REDIS_REPLY_STATUS == _redis_reply->type
             && 0 == strcasecmp(_redis_reply->str, "OK")) {
         ret = REDIS_SETEX_OK;
@@ -241,7 +655,7 @@ int RedisProxy::setex(const char* key, const char* value, uint32_t size, uint64_
 
 int RedisProxy::incr(const char* key, int64_t* value) {
     int ret = -1;
-    if (REDIS_RETURN_OK == __execute_command("INCR %s", key) 
+    if (REDIS_RETURN_OK == __execute_command(key, 0, "INCR %s", key) 
             && REDIS_REPLY_INTEGER == _redis_reply->type) {
         ret = REDIS_INCR_OK;
         if (NULL != value) {
@@ -259,7 +673,7 @@ int RedisProxy::lpush(const char* key,
                         uint32_t size, 
                         uint64_t* list_len){
     int ret = -1;
-    if (REDIS_RETURN_OK == __execute_command("LPUSH %s %b", key, value, size)
+    if (REDIS_RETURN_OK == __execute_command(key, size, "LPUSH %s %b", key, value, size)
             && REDIS_REPLY_INTEGER == _redis_reply->type) {
         ret = REDIS_LPUSH_OK;
         if (NULL != list_len){
@@ -277,7 +691,7 @@ int RedisProxy::rpush(const char* key,
                         uint32_t size,
                         uint64_t* list_len){
     int ret = -1;
-    if (REDIS_RETURN_OK == __execute_command("RPUSH %s %b", key, value, size)
+    if (REDIS_RETURN_OK == __execute_command(key, size, "RPUSH %s %b", key, value, size)
             && REDIS_REPLY_INTEGER == _redis_reply->type) {
         ret = REDIS_RPUSH_OK;
         if (NULL != list_len) {
@@ -296,7 +710,7 @@ int RedisProxy::smembers(const char* key, std::vector<std::string>* value_vec){
     if (NULL == value_vec){
         return ret;
     }
-    if (REDIS_RETURN_OK == __execute_command("SMEMBERS %s", key)
+    if (REDIS_RETURN_OK == __execute_command(key, 0, "SMEMBERS %s", key)
             && REDIS_REPLY_ARRAY == _redis_reply->type) {
         ret = REDIS_SMEMBERS_OK;
         for (size_t i = 0; i < _redis_reply->elements; i++){
@@ -315,7 +729,7 @@ int RedisProxy::sadd(const char* key,
                     uint32_t size,
                     uint64_t* set_len){
     int ret = -1;
-    if (REDIS_RETURN_OK == __execute_command("SADD %s %b", key, value, size)
+    if (REDIS_RETURN_OK == __execute_command(key, size, "SADD %s %b", key, value, size)
             && REDIS_REPLY_INTEGER == _redis_reply->type) {
         ret = REDIS_SADD_OK;
         if (NULL != set_len){
@@ -334,7 +748,7 @@ int RedisProxy::srem(const char* key,
                     uint32_t size,
                     uint64_t* set_len){
     int ret = -1;
-    if (REDIS_RETURN_OK == __execute_command("SREM %s %b", key, value, size)
+    if (REDIS_RETURN_OK == __execute_command(key, size, "SREM %s %b", key, value, size)
             && REDIS_REPLY_INTEGER == _redis_reply->type) {
         ret = REDIS_SREM_OK;
         if (NULL != set_len){
@@ -350,7 +764,7 @@ int RedisProxy::srem(const char* key,
 
 int RedisProxy::ltrim(const char* key, int32_t start, int32_t end){
     int ret = -1;
-    if (REDIS_RETURN_OK == __execute_command("LTRIM %s %d %d", key, start, end)
+    if (REDIS_RETURN_OK == __execute_command(key, 0, "LTRIM %s %d %d", key, start, end)
             && REDIS_REPLY_STATUS == _redis_reply->type
             && 0 == strcasecmp(_redis_reply->str, "OK")) {
         ret = REDIS_LTRIM_OK;
@@ -368,7 +782,7 @@ int RedisProxy::lrange(const char* key,
                        std::vector<std::string>* values) {
     int ret = -1;
     if (values 
-            && REDIS_RETURN_OK == __execute_command("LRANGE %s %d %d", key, start, end)
+            && REDIS_RETURN_OK == __execute_command(key, 0, "LRANGE %s %d %d", key, start, end)
             && REDIS_REPLY_ARRAY == _redis_reply->type) {
         ret = REDIS_LRANGE_OK; 
         for (size_t i = 0; i < _redis_reply->elements; i++){
@@ -385,7 +799,7 @@ int RedisProxy::hget(const char* key,
         const char* field,
         std::string& value) {
     int ret = -1;
-    if (REDIS_RETURN_OK == __execute_command("HGET %s %s", key, field)) {
+    if (REDIS_RETURN_OK == __execute_command(key, 0, "HGET %s %s", key, field)) {
         if (REDIS_REPLY_NIL == _redis_reply->type) {
             ret = REDIS_HGET_NOT_EXIST; 
         }
@@ -403,7 +817,7 @@ int RedisProxy::hget(const char* key,
 int RedisProxy::zcard(const char* key,
                     uint64_t* sorted_set_len){
     int ret = -1;
-    if (REDIS_RETURN_OK == __execute_command("ZCARD %s", key)
+    if (REDIS_RETURN_OK == __execute_command(key, 0, "ZCARD %s", key)
             && REDIS_REPLY_INTEGER == _redis_reply->type) {
         ret = REDIS_ZCARD_OK;
         if (NULL != sorted_set_len){
@@ -423,7 +837,7 @@ int RedisProxy::zadd(const char* key,
                     int64_t score,
                     uint64_t* added_len){
     int ret = -1;
-    if (REDIS_RETURN_OK == __execute_command("ZADD %s %ld %b", key, score, value, size)
+    if (REDIS_RETURN_OK == __execute_command(key, size, "ZADD %s %ld %b", key, score, value, size)
             && REDIS_REPLY_INTEGER == _redis_reply->type) {
         ret = REDIS_ZADD_OK;
         if (NULL != added_len){
@@ -442,7 +856,8 @@ int RedisProxy::zincr(const char* key,
                     uint32_t size,
                     int32_t increment){
     int ret = -1;
-    if (REDIS_RETURN_OK == __execute_command("ZINCRBY %s %d %b", key, increment, value, size)
+    if (REDIS_RETURN_OK == __execute_command(key, size, "ZINCRBY %s %d %b",
+                                             key, increment, value, size)
             && REDIS_REPLY_STRING == _redis_reply->type) {
         ret = REDIS_ZINCR_OK;
     } else {
@@ -458,7 +873,7 @@ int RedisProxy::zscore(const char* key,
                     uint32_t size,
                     std::string& score) {
     int ret = -1;
-    if (REDIS_RETURN_OK == __execute_command("ZSCORE %s %b", key, value, size)) {
+    if (REDIS_RETURN_OK == __execute_command(key, size, "ZSCORE %s %b", key, value, size)) {
         if (REDIS_REPLY_NIL == _redis_reply->type) {
             ret = REDIS_ZSCORE_NOT_EXIST; 
         }
@@ -478,7 +893,7 @@ int RedisProxy::zrem(const char* key,
                     uint32_t size,
                     uint64_t* remed_len){
     int ret = -1;
-    if (REDIS_RETURN_OK == __execute_command("ZREM %s %b", key, value, size)
+    if (REDIS_RETURN_OK == __execute_command(key, size, "ZREM %s %b", key, value, size)
             && REDIS_REPLY_INTEGER == _redis_reply->type) {
         ret = REDIS_ZREM_OK;
         if (NULL != remed_len){
@@ -503,7 +918,7 @@ int RedisProxy::zrange(const char* key,
         return ret;
     }
     const char* command = with_score ? "ZRANGE %s %d %d WITHSCORES" : "ZRANGE %s %d %d";
-    if (REDIS_RETURN_OK == __execute_command(command, key, start, end)
+    if (REDIS_RETURN_OK == __execute_command(key, 0, command, key, start, end)
             && REDIS_REPLY_ARRAY == _redis_reply->type) {
         ret = REDIS_ZRANGE_OK;
         for (size_t i = 0; i < _redis_reply->elements; i++) {
@@ -527,7 +942,8 @@ int RedisProxy::zremrangebyrank(const char* key,
                     int32_t stop,
                     uint64_t* remed_len){
     int ret = -1;
-    if (REDIS_RETURN_OK == __execute_command("ZREMRANGEBYRANK %s %d %d", key, start, stop)
+    if (REDIS_RETURN_OK == __execute_command(key, 0, "ZREMRANGEBYRANK %s %d %d",
+                                             key, start, stop)
             && REDIS_REPLY_INTEGER == _redis_reply->type) {
         ret = REDIS_ZREMRANGEBYRANK_OK;
         if (NULL != remed_len){
@@ -540,6 +956,102 @@ int RedisProxy::zremrangebyrank(const char* key,
 
     return ret;
 }
+
+int RedisProxy::lmpop(const char* key,
+                    uint32_t count,
+                    std::vector<std::string>* values,
+                    uint32_t block_timeout){
+    int ret = -1;
+    if (NULL == values){
+        return REDIS_LMPOP_ERR;
+    }
+    int exec_ret = (0 == block_timeout)
+        ? __execute_command(key, 0, "LMPOP 1 %s LEFT COUNT %u", key, count)
+        : __execute_command(key, 0, "BLMPOP %u 1 %s LEFT COUNT %u", block_timeout, key, count);
+    if (REDIS_RETURN_OK == exec_ret) {
+        if (REDIS_REPLY_NIL == _redis_reply->type) {
+            ret = REDIS_LMPOP_EMPTY;
+        } else if (REDIS_REPLY_ARRAY == _redis_reply->type
+                && 2 == _redis_reply->elements
+                && REDIS_REPLY_ARRAY == _redis_reply->element[1]->type) {
+            ret = REDIS_LMPOP_OK;
+            const redisReply* list = _redis_reply->element[1];
+            for (size_t i = 0; i < list->elements; i++) {
+                values->push_back(std::string(list->element[i]->str, list->element[i]->len));
+            }
+        } else {
+            ret = REDIS_LMPOP_ERR;
+        }
+    } else {
+        ret = REDIS_LMPOP_ERR;
+    }
+    freeReplyObject(_redis_reply);
+
+    return ret;
+}
+
+int RedisProxy::lmove(const char* source,
+                    const char* destination,
+                    std::string& value,
+                    uint32_t block_timeout){
+    int ret = -1;
+    int exec_ret = (0 == block_timeout)
+        ? __execute_command(source, 0, "LMOVE %s %s LEFT RIGHT", source, destination)
+        : __execute_command(source, 0, "BLMOVE %s %s LEFT RIGHT %u",
+                            source, destination, block_timeout);
+    if (REDIS_RETURN_OK == exec_ret) {
+        if (REDIS_REPLY_NIL == _redis_reply->type) {
+            ret = REDIS_LMOVE_EMPTY;
+        } else if (REDIS_REPLY_STRING == _redis_reply->type) {
+            value.assign(_redis_reply->str, _redis_reply->len);
+            ret = REDIS_LMOVE_OK;
+        } else {
+            ret = REDIS_LMOVE_ERR;
+        }
+    } else {
+        ret = REDIS_LMOVE_ERR;
+    }
+    freeReplyObject(_redis_reply);
+
+    return ret;
+}
+
+int RedisProxy::lrem(const char* key,
+                    const char* value,
+                    uint32_t size,
+                    int32_t count,
+                    uint64_t* remed_len){
+    int ret = -1;
+    if (REDIS_RETURN_OK == __execute_command(key, size, "LREM %s %d %b", key, count, value, size)
+            && REDIS_REPLY_INTEGER == _redis_reply->type) {
+        ret = REDIS_LREM_OK;
+        if (NULL != remed_len){
+            *remed_len = _redis_reply->integer;
+        }
+    } else {
+        ret = REDIS_LREM_ERR;
+    }
+    freeReplyObject(_redis_reply);
+
+    return ret;
+}
+
+int RedisProxy::llen(const char* key,
+                    uint64_t* list_len){
+    int ret = -1;
+    if (REDIS_RETURN_OK == __execute_command(key, 0, "LLEN %s", key)
+            && REDIS_REPLY_INTEGER == _redis_reply->type) {
+        ret = REDIS_LLEN_OK;
+        if (NULL != list_len){
+            *list_len = _redis_reply->integer;
+        }
+    } else {
+        ret = REDIS_LLEN_ERR;
+    }
+    freeReplyObject(_redis_reply);
+
+    return ret;
+}
 }
 
 /* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
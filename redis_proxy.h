@@ -10,7 +10,9 @@
 #ifndef  __REDIS_PROXY_H_
 #define  __REDIS_PROXY_H_
 
+#include <stddef.h>
 #include <stdint.h>
+#include <deque>
 #include <string>
 #include <vector>
 
@@ -19,6 +21,20 @@ struct redisReply;
 
 namespace tis {
 
+class HotKeyDetector;
+class TrafficRecorder;
+
+// one command in RESP, pointing into the parsed buffer
+struct RespCommand {
+    const char* name;
+    size_t name_len;
+    const char* key;            // second argument, NULL if there is none
+    size_t key_len;
+    uint64_t value_size;        // bytes of the arguments after the key
+    uint64_t arg_num;
+    size_t size;                // bytes of the whole command
+};
+
 class RedisProxy {
 public:
     static const uint32_t DEFAULT_RETRY_NUM = 1;
@@ -95,6 +111,24 @@ public:
 
     static const int REDIS_ZREMRANGEBYRANK_OK = 0;
     static const int REDIS_ZREMRANGEBYRANK_ERR = 1;
+
+    static const int REDIS_LMPOP_OK = 0;
+    static const int REDIS_LMPOP_EMPTY = 1;
+    static const int REDIS_LMPOP_ERR = 2;
+
+    static const int REDIS_LMOVE_OK = 0;
+    static const int REDIS_LMOVE_EMPTY = 1;
+    static const int REDIS_LMOVE_ERR = 2;
+
+    static const int REDIS_LREM_OK = 0;
+    static const int REDIS_LREM_ERR = 1;
+
+    static const int REDIS_LLEN_OK = 0;
+    static const int REDIS_LLEN_ERR = 1;
+
+    static const int REDIS_PARSE_OK = 0;
+    static const int REDIS_PARSE_INCOMPLETE = 1;
+    static const int REDIS_PARSE_ERR = 2;
 public:
     RedisProxy();
     virtual ~RedisProxy();
@@ -104,6 +138,13 @@ public:
     uint32_t get_port() const { return _port; }
     uint32_t get_retry_num() const { return _retry_num; }
     long get_timeout() const { return _timeout; }
+    // not owned, may be shared by proxies of different threads and endpoints; NULL disables
+    void set_hot_key_detector(HotKeyDetector* detector);
+    HotKeyDetector* get_hot_key_detector() const { return _hot_key_detector; }
+    // not owned, every command is written to the trace, pipelined ones included with the
+    // latency from their append to the read of their reply; NULL disables
+    void set_traffic_recorder(TrafficRecorder* recorder);
+    TrafficRecorder* get_traffic_recorder() const { return _traffic_recorder; }
     RedisProxy* duplicate() const;
     int connect(const char* host, uint32_t port);
     void close_connection();
@@ -172,8 +213,79 @@ public:
                 int32_t end,
                 uint64_t* remed_len = NULL);
 
+    // pop up to count values from the head, block_timeout in seconds, 0 means not blocking
+    int lmpop(const char* key,
+                uint32_t count,
+                std::vector<std::string>* values,
+                uint32_t block_timeout = 0);
+    // move the head of source to the tail of destination
+    int lmove(const char* source,
+                const char* destination,
+                std::string& value,
+                uint32_t block_timeout = 0);
+    int lrem(const char* key,
+                const char* value,
+                uint32_t size,
+                int32_t count = 1,
+                uint64_t* remed_len = NULL);
+    int llen(const char* key,
+                uint64_t* list_len);
+
+    // pipelining: queue commands with append_command(), then call get_reply() once per
+    // appended command, in order, before issuing any other command. reply is freed by
+    // the caller with freeReplyObject()
+    int append_command(const char* fmt, ...);
+    // cmd is already RESP encoded and may hold any number of commands
+    int append_formatted_command(const char* cmd, size_t len);
+    // like append_formatted_command() + flush_commands(), but cmd goes to the socket
+    // straight from the caller's memory instead of being copied into the output buffer
+    int write_formatted_command(const char* cmd, size_t len);
+    // write out everything appended so far
+    int flush_commands();
+    // error replies are logged unless log_error is false, callers reporting them on their
+    // own (e.g. the bulk loader) turn it off
+    int get_reply(redisReply** reply, bool log_error = true);
+    // like get_reply() but never waits and never logs error replies, *reply is NULL when
+    // nothing has arrived yet
+    int try_get_reply(redisReply** reply);
+
+    // parses the multibulk command at the start of buf
+    static int parse_command(const char* buf, size_t len, RespCommand* command);
+
 private:
-    int __execute_command(const char* fmt, ...);
+    static const uint32_t COMMAND_CACHE_BITS = 5;
+    static const uint32_t MAX_COMMAND_NAME_LEN = 24;
+
+    // command of a format string, looked up once per format
+    struct CommandInfo {
+        const char* fmt;
+        uint8_t code;           // TrafficRecorder::command_code
+        char name[MAX_COMMAND_NAME_LEN];
+    };
+
+    // a pipelined command waiting for its reply, kept only when tracing or sampling
+    struct PendingCommand {
+        uint8_t code;           // TrafficRecorder::command_code
+        bool sampled;
+        bool has_key;
+        uint32_t value_size;
+        uint64_t start_us;
+        uint64_t start_mono_us;
+        std::string name;       // upper cased, only when sampled
+        std::string key;
+    };
+
+    // fmt must outlive the proxy, as the formats of this class do
+    const CommandInfo* __get_command_info(const char* fmt);
+    bool __sample_command();
+    // cmd holds the RESP of the commands just appended
+    void __trace_append(const char* cmd, size_t len);
+    void __trace_reply(const redisReply* reply, int result);
+    // the connection went away with the replies of the pending commands
+    void __trace_drop();
+    int __check_connection();
+    // key and value_size are only used for hot key sampling and tracing, key may be NULL
+    int __execute_command(const char* key, uint32_t value_size, const char* fmt, ...);
     const char* __get_err_msg(); 
 
     const char* _host;
@@ -185,6 +297,12 @@ private:
     redisContext* _redis_context;
     redisReply* _redis_reply;
 
+    HotKeyDetector* _hot_key_detector;
+    uint32_t _sample_countdown;
+    TrafficRecorder* _traffic_recorder;
+    CommandInfo _command_cache[1 << COMMAND_CACHE_BITS];
+    std::deque<PendingCommand> _pending_commands;
+
     RedisProxy(const RedisProxy&);
     RedisProxy& operator=(const RedisProxy&);
 };
@@ -0,0 +1,373 @@
+ 
+/**
+ * @file redis_queue_consumer.cpp
+ * @author way
+ * @date 2026/10/18 14:31:12
+ * @brief
+ *
+ **/
+
+#include "redis_queue_consumer.h"
+
+#include <unistd.h>
+#include <algorithm>
+#include <new>
+
+#include "hiredis.h"
+#include "glog/logging.h"
+#include "redis_proxy.h"
+
+namespace tis {
+
+RedisQueueConsumer::RedisQueueConsumer() {
+    _reliable = false;
+    _batch_size = DEFAULT_BATCH_SIZE;
+    _block_timeout = DEFAULT_BLOCK_TIMEOUT;
+    _fail_policy = FAIL_REQUEUE;
+    _max_retries = DEFAULT_MAX_RETRIES;
+    _fail_backoff_ms = DEFAULT_FAIL_BACKOFF_MS;
+    _max_fail_backoff_ms = DEFAULT_MAX_FAIL_BACKOFF_MS;
+    _cur_backoff_ms = 0;
+    _stop = false;
+    _consumed_num = 0;
+    _acked_num = 0;
+    _dead_num = 0;
+    _redis_proxy = NULL;
+}
+
+RedisQueueConsumer::~RedisQueueConsumer() {
+    delete _redis_proxy;
+}
+
+void RedisQueueConsumer::set_batch_size(uint32_t batch_size) {
+    _batch_size = (0 == batch_size) ? 1 : batch_size;
+}
+
+void RedisQueueConsumer::set_block_timeout(uint32_t block_timeout) {
+    // 0 would block forever
+    _block_timeout = (0 == block_timeout) ? 1 : block_timeout;
+}
+
+void RedisQueueConsumer::set_fail_policy(int fail_policy) {
+    _fail_policy = (FAIL_PARK == fail_policy) ? FAIL_PARK : FAIL_REQUEUE;
+}
+
+void RedisQueueConsumer::set_max_retries(uint32_t max_retries, const char* dead_letter_queue) {
+    _max_retries = max_retries;
+    _dead_letter_queue = (NULL == dead_letter_queue) ? "" : dead_letter_queue;
+}
+
+void RedisQueueConsumer::set_fail_backoff(uint32_t backoff_ms, uint32_t max_backoff_ms) {
+    _fail_backoff_ms = backoff_ms;
+    _max_fail_backoff_ms = std::max(backoff_ms, max_backoff_ms);
+}
+
+int RedisQueueConsumer::init(const RedisProxy& proxy,
+                            const char* queue,
+                            const char* processing_queue) {
+    if (NULL == queue || '\0' == queue[0]) {
+        LOG(WARNING) << "redis queue consumer: illegal queue";
+        return 1;
+    }
+    if (NULL != _redis_proxy) {
+        LOG(WARNING) << "redis queue consumer: already inited, queue[" << _queue << "]";
+        return 1;
+    }
+    _redis_proxy = new(std::nothrow) RedisProxy;
+    if (NULL == _redis_proxy) {
+        return 1;
+    }
+    _redis_proxy->set_retry_num(proxy.get_retry_num());
+    // socket timeout has to outlast the blocking pop
+    _redis_proxy->set_timeout(proxy.get_timeout() + _block_timeout * 1000);
+    _redis_proxy->set_hot_key_detector(proxy.get_hot_key_detector());
+    _redis_proxy->set_traffic_recorder(proxy.get_traffic_recorder());
+    if (0 != _redis_proxy->connect(proxy.get_host(), proxy.get_port())) {
+        LOG(WARNING) << "redis queue consumer: connect failed, queue[" << queue << "]";
+        delete _redis_proxy;
+        _redis_proxy = NULL;
+        return 1;
+    }
+    _queue = queue;
+    _reliable = (NULL != processing_queue && '\0' != processing_queue[0]);
+    if (_reliable) {
+        _processing_queue = processing_queue;
+        _retry_hash = _processing_queue + ":retries";
+        if (_dead_letter_queue.empty()) {
+            _dead_letter_queue = _queue + ":dead";
+        }
+    }
+    _cur_backoff_ms = 0;
+    _stop = false;
+    return 0;
+}
+
+int RedisQueueConsumer::__pop(std::vector<std::string>* items) {
+    int ret = _redis_proxy->lmpop(_queue.c_str(), _batch_size, items, _block_timeout);
+    if (RedisProxy::REDIS_LMPOP_OK == ret) {
+        return CONSUME_OK;
+    }
+    if (RedisProxy::REDIS_LMPOP_EMPTY == ret) {
+        return CONSUME_EMPTY;
+    }
+    return CONSUME_ERR;
+}
+
+int RedisQueueConsumer::__reliable_pop(std::vector<std::string>* items) {
+    std::string value;
+    int ret = _redis_proxy->lmove(_queue.c_str(),
+                                _processing_queue.c_str(),
+                                value,
+                                _block_timeout);
+    if (RedisProxy::REDIS_LMOVE_EMPTY == ret) {
+        return CONSUME_EMPTY;
+    }
+    if (RedisProxy::REDIS_LMOVE_OK != ret) {
+        return CONSUME_ERR;
+    }
+    items->push_back(value);
+    if (_batch_size <= 1) {
+        return CONSUME_OK;
+    }
+
+    // the rest of the batch in one round trip, bounded by what is queued so a trickling
+    // queue does not cost a pipeline of nil LMOVEs per item
+    uint64_t queue_len = 0;
+    if (RedisProxy::REDIS_LLEN_OK != _redis_proxy->llen(_queue.c_str(), &queue_len)) {
+        return CONSUME_OK;
+    }
+    uint64_t more = std::min(queue_len, static_cast<uint64_t>(_batch_size - 1));
+    uint32_t appended = 0;
+    for (; appended < more; ++appended) {
+        int append_ret = _redis_proxy->append_command("LMOVE %s %s LEFT RIGHT",
+                                                    _queue.c_str(),
+                                                    _processing_queue.c_str());
+        if (RedisProxy::REDIS_RETURN_OK != append_ret) {
+            break;
+        }
+    }
+    for (uint32_t i = 0; i < appended; ++i) {
+        redisReply* reply = NULL;
+        int reply_ret = _redis_proxy->get_reply(&reply);
+        if (RedisProxy::REDIS_REQUEST_ERR == reply_ret) {
+            // the connection is gone, whatever was moved stays in the processing queue
+            break;
+        }
+        if (RedisProxy::REDIS_RETURN_OK == reply_ret && REDIS_REPLY_STRING == reply->type) {
+            items->push_back(std::string(reply->str, reply->len));
+        }
+        freeReplyObject(reply);
+    }
+    return CONSUME_OK;
+}
+
+int RedisQueueConsumer::__ack(const std::vector<std::string>& items,
+                            const std::string* dest,
+                            uint64_t* settled_num) {
+    // an item is pushed to dest before it leaves the processing queue, so a crash in
+    // between delivers it twice rather than never. its failure count goes away with it,
+    // unless it is requeued for another attempt
+    bool clear_retries = (0 != _max_retries && &_queue != dest);
+    uint32_t cmd_num = ((NULL != dest) ? 1 : 0) + 1 + (clear_retries ? 1 : 0);
+    uint32_t reply_num = 0;
+    size_t appended = 0;
+    for (; appended < items.size(); ++appended) {
+        const std::string& item = items[appended];
+        if (NULL != dest) {
+            if (RedisProxy::REDIS_RETURN_OK != _redis_proxy->append_command("RPUSH %s %b",
+                                                                        dest->c_str(),
+                                                                        item.data(),
+                                                                        item.size())) {
+                break;
+            }
+            ++reply_num;
+        }
+        if (RedisProxy::REDIS_RETURN_OK != _redis_proxy->append_command("LREM %s 1 %b",
+                                                                    _processing_queue.c_str(),
+                                                                    item.data(),
+                                                                    item.size())) {
+            break;
+        }
+        ++reply_num;
+        if (clear_retries) {
+            if (RedisProxy::REDIS_RETURN_OK != _redis_proxy->append_command("HDEL %s %b",
+                                                                        _retry_hash.c_str(),
+                                                                        item.data(),
+                                                                        item.size())) {
+                break;
+            }
+            ++reply_num;
+        }
+    }
+    int ret = (appended == items.size()) ? 0 : 1;
+    uint64_t settled = 0;
+    bool item_ok = true;
+    for (uint32_t i = 0; i < reply_num; ++i) {
+        redisReply* reply = NULL;
+        int reply_ret = _redis_proxy->get_reply(&reply);
+        if (RedisProxy::REDIS_REQUEST_ERR == reply_ret) {
+            ret = 1;
+            break;
+        }
+        if (RedisProxy::REDIS_RETURN_OK != reply_ret) {
+            ret = 1;
+            item_ok = false;
+        }
+        freeReplyObject(reply);
+        if (0 == (i + 1) % cmd_num) {
+            if (item_ok) {
+                ++settled;
+            }
+            item_ok = true;
+        }
+    }
+    if (NULL != settled_num) {
+        *settled_num = settled;
+    }
+    if (0 != ret) {
+        LOG(WARNING) << "redis queue consumer: ack failed, queue[" << _processing_queue
+            << "] dest[" << ((NULL != dest) ? dest->c_str() : "") << "] batch["
+            << items.size() << "] settled[" << settled << "]";
+    }
+    return ret;
+}
+
+int RedisQueueConsumer::__requeue(const std::vector<std::string>& items) {
+    if (0 == _max_retries) {
+        return __ack(items, &_queue, NULL);
+    }
+    // count the failure of every item in one round trip
+    size_t appended = 0;
+    for (; appended < items.size(); ++appended) {
+        if (RedisProxy::REDIS_RETURN_OK != _redis_proxy->append_command("HINCRBY %s %b 1",
+                                                                    _retry_hash.c_str(),
+                                                                    items[appended].data(),
+                                                                    items[appended].size())) {
+            break;
+        }
+    }
+    std::vector<std::string> retry_items;
+    std::vector<std::string> dead_items;
+    for (size_t i = 0; i < appended; ++i) {
+        redisReply* reply = NULL;
+        int reply_ret = _redis_proxy->get_reply(&reply);
+        if (RedisProxy::REDIS_REQUEST_ERR == reply_ret) {
+            // the connection is gone, the batch stays in the processing queue
+            return 1;
+        }
+        if (RedisProxy::REDIS_RETURN_OK == reply_ret
+                && REDIS_REPLY_INTEGER == reply->type
+                && reply->integer > static_cast<long long>(_max_retries)) {
+            dead_items.push_back(items[i]);
+        } else {
+            retry_items.push_back(items[i]);
+        }
+        freeReplyObject(reply);
+    }
+    retry_items.insert(retry_items.end(), items.begin() + appended, items.end());
+
+    int ret = 0;
+    if (!retry_items.empty() && 0 != __ack(retry_items, &_queue, NULL)) {
+        ret = 1;
+    }
+    if (!dead_items.empty()) {
+        uint64_t dead_num = 0;
+        if (0 != __ack(dead_items, &_dead_letter_queue, &dead_num)) {
+            ret = 1;
+        }
+        _dead_num += dead_num;
+        LOG(WARNING) << "redis queue consumer: items failed more than " << _max_retries
+            << " times, queue[" << _queue << "] dead_letter_queue[" << _dead_letter_queue
+            << "] num[" << dead_num << "]";
+    }
+    return ret;
+}
+
+void RedisQueueConsumer::__fail_backoff() {
+    if (0 == _fail_backoff_ms) {
+        return;
+    }
+    uint64_t backoff_ms = (0 == _cur_backoff_ms) ? _fail_backoff_ms : 2ULL * _cur_backoff_ms;
+    _cur_backoff_ms = std::min(backoff_ms, static_cast<uint64_t>(_max_fail_backoff_ms));
+    sleep(_cur_backoff_ms / 1000);
+    usleep(_cur_backoff_ms % 1000 * 1000);
+}
+
+int RedisQueueConsumer::consume(QueueHandler* handler) {
+    if (NULL == handler || NULL == _redis_proxy) {
+        return CONSUME_ERR;
+    }
+    std::vector<std::string> items;
+    items.reserve(_batch_size);
+    int ret = _reliable ? __reliable_pop(&items) : __pop(&items);
+    if (CONSUME_OK != ret) {
+        return ret;
+    }
+    _consumed_num += items.size();
+    int handle_ret = handler->handle(items);
+    if (QueueHandler::HANDLE_STOP == handle_ret) {
+        _stop = true;
+    }
+    if (QueueHandler::HANDLE_FAIL == handle_ret) {
+        if (!_reliable) {
+            LOG(WARNING) << "redis queue consumer: handle failed, items dropped, queue["
+                << _queue << "] batch[" << items.size() << "]";
+        } else if (FAIL_PARK == _fail_policy) {
+            LOG(WARNING) << "redis queue consumer: handle failed, items parked until recover, "
+                << "queue[" << _processing_queue << "] batch[" << items.size() << "]";
+        } else {
+            __requeue(items);
+        }
+        __fail_backoff();
+        return CONSUME_OK;
+    }
+    _cur_backoff_ms = 0;
+    if (_reliable) {
+        uint64_t acked_num = 0;
+        __ack(items, NULL, &acked_num);
+        _acked_num += acked_num;
+    } else {
+        _acked_num += items.size();
+    }
+    return CONSUME_OK;
+}
+
+int RedisQueueConsumer::run(QueueHandler* handler) {
+    if (NULL == handler || NULL == _redis_proxy) {
+        return 1;
+    }
+    while (!_stop) {
+        if (CONSUME_ERR == consume(handler)) {
+            // don't spin on a dead server, the reconnect happens in the next pop
+            sleep(1);
+        }
+    }
+    _stop = false;
+    return 0;
+}
+
+void RedisQueueConsumer::stop() {
+    _stop = true;
+}
+
+int RedisQueueConsumer::recover(uint64_t* recovered_num) {
+    if (!_reliable || NULL == _redis_proxy) {
+        return 1;
+    }
+    uint64_t num = 0;
+    std::string value;
+    int ret = RedisProxy::REDIS_LMOVE_OK;
+    while (RedisProxy::REDIS_LMOVE_OK == (ret = _redis_proxy->lmove(_processing_queue.c_str(),
+                                                                  _queue.c_str(),
+                                                                  value))) {
+        ++num;
+    }
+    if (NULL != recovered_num) {
+        *recovered_num = num;
+    }
+    return (RedisProxy::REDIS_LMOVE_EMPTY == ret) ? 0 : 1;
+}
+
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
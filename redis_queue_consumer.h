@@ -0,0 +1,130 @@
+ 
+/**
+ * @file redis_queue_consumer.h
+ * @author way
+ * @date 2026/10/18 14:05:47
+ * @brief list based work queue consumer, blocking batched pops with optional acks
+ *
+ **/
+
+#ifndef  __REDIS_QUEUE_CONSUMER_H_
+#define  __REDIS_QUEUE_CONSUMER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace tis {
+
+class RedisProxy;
+
+class QueueHandler {
+public:
+    static const int HANDLE_OK = 0;      // ack the batch
+    // reliable mode: see RedisQueueConsumer::set_fail_policy; simple mode: dropped
+    static const int HANDLE_FAIL = 1;
+    static const int HANDLE_STOP = 2;    // ack the batch and stop run()
+public:
+    virtual ~QueueHandler() {}
+    // called on the consumer thread, no more items are popped until it returns
+    virtual int handle(const std::vector<std::string>& items) = 0;
+};
+
+/*
+ * Consumes a list fed by rpush (or lpush for LIFO) from the head.
+ *
+ * Simple mode pops a batch with one BLMPOP (redis >= 7.0); items are gone once popped.
+ * Reliable mode (processing queue given, redis >= 6.2) moves items to the processing
+ * list with BLMOVE + pipelined LMOVE (bounded by LLEN) and removes them with pipelined LREM
+ * once the handler acks them, so items of a crashed consumer can be put back with recover().
+ * A batch the handler fails is pushed back to the tail of the queue, an item that keeps
+ * failing ends up in a dead letter queue, and the consumer backs off after every failed
+ * batch so a poison item can not spin the server.
+ *
+ * The consumer owns a dedicated connection, since it spends most of its time blocked.
+ */
+class RedisQueueConsumer {
+public:
+    static const uint32_t DEFAULT_BATCH_SIZE = 100;
+    static const uint32_t DEFAULT_BLOCK_TIMEOUT = 1;
+    static const uint32_t DEFAULT_MAX_RETRIES = 16;
+    static const uint32_t DEFAULT_FAIL_BACKOFF_MS = 100;
+    static const uint32_t DEFAULT_MAX_FAIL_BACKOFF_MS = 5000;
+
+    static const int FAIL_REQUEUE = 0;
+    static const int FAIL_PARK = 1;
+
+    static const int CONSUME_OK = 0;
+    static const int CONSUME_EMPTY = 1;
+    static const int CONSUME_ERR = 2;
+public:
+    RedisQueueConsumer();
+    virtual ~RedisQueueConsumer();
+    void set_batch_size(uint32_t batch_size);
+    // seconds, bounds how long stop() may wait
+    void set_block_timeout(uint32_t block_timeout);
+    // reliable mode: FAIL_REQUEUE puts a failed batch back at the tail of the queue,
+    // FAIL_PARK leaves it in the processing queue until recover()
+    void set_fail_policy(int fail_policy);
+    // FAIL_REQUEUE: an item failed more than max_retries times goes to dead_letter_queue
+    // (NULL means <queue>:dead) instead, 0 retries forever. failures are counted in the
+    // hash <processing_queue>:retries, shared by all consumers of the queue
+    void set_max_retries(uint32_t max_retries, const char* dead_letter_queue = NULL);
+    // consume() sleeps backoff_ms after a failed batch, doubled per further failure up to
+    // max_backoff_ms and reset by a handled batch; also bounds how long stop() may wait
+    void set_fail_backoff(uint32_t backoff_ms, uint32_t max_backoff_ms);
+    uint32_t get_batch_size() const { return _batch_size; }
+    uint32_t get_block_timeout() const { return _block_timeout; }
+    uint64_t get_consumed_num() const { return _consumed_num; }
+    uint64_t get_acked_num() const { return _acked_num; }
+    uint64_t get_dead_num() const { return _dead_num; }
+    // connects to the endpoint of proxy, call after the setters
+    int init(const RedisProxy& proxy, const char* queue, const char* processing_queue = NULL);
+    // pop one batch and hand it to handler
+    int consume(QueueHandler* handler);
+    // consume until stop() or HANDLE_STOP
+    int run(QueueHandler* handler);
+    void stop();
+    // reliable mode only: move everything left in the processing queue back to the tail
+    // of the queue, for a processing queue whose consumer is gone
+    int recover(uint64_t* recovered_num = NULL);
+
+private:
+    int __pop(std::vector<std::string>* items);
+    int __reliable_pop(std::vector<std::string>* items);
+    // remove items from the processing queue, pushing them to dest first unless it is NULL
+    int __ack(const std::vector<std::string>& items,
+                const std::string* dest,
+                uint64_t* settled_num);
+    // FAIL_REQUEUE handling of a failed batch
+    int __requeue(const std::vector<std::string>& items);
+    void __fail_backoff();
+
+    std::string _queue;
+    std::string _processing_queue;
+    std::string _retry_hash;
+    std::string _dead_letter_queue;
+    bool _reliable;
+    uint32_t _batch_size;
+    uint32_t _block_timeout;
+    int _fail_policy;
+    uint32_t _max_retries;
+    uint32_t _fail_backoff_ms;
+    uint32_t _max_fail_backoff_ms;
+    uint32_t _cur_backoff_ms;
+    volatile bool _stop;
+    uint64_t _consumed_num;
+    uint64_t _acked_num;
+    uint64_t _dead_num;
+
+    RedisProxy* _redis_proxy;
+
+    RedisQueueConsumer(const RedisQueueConsumer&);
+    RedisQueueConsumer& operator=(const RedisQueueConsumer&);
+};
+
+}
+
+#endif  //__REDIS_QUEUE_CONSUMER_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,392 @@
+ 
+/**
+ * @file redis_replay.cpp
+ * @author way
+ * @date 2026/10/18 18:03:45
+ * @brief replays a TrafficRecorder trace through RedisProxy against a (local) redis
+ *
+ * ./redis_replay --trace_file=./redis.trace --host=127.0.0.1 --port=6379 --thread_num=16 --speed=2
+ * ./redis_replay --trace_file=./redis.trace --rate=200000
+ *
+ * Commands are split over threads by key hash, so the order per key is kept. Every
+ * command has a due time, from the recorded timestamps divided by speed, or from rate
+ * when given (open loop). Response time is measured from the due time, so a slow server
+ * is not hidden by the driver falling behind; service time is measured from the send.
+ **/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "redis_proxy.h"
+#include "time_util.h"
+#include "traffic_recorder.h"
+
+DEFINE_string(trace_file, "./redis.trace", "trace written by TrafficRecorder");
+DEFINE_string(host, "127.0.0.1", "redis host");
+DEFINE_int32(port, 6379, "redis port");
+DEFINE_int32(thread_num, 8, "replay threads, one connection each");
+DEFINE_double(speed, 1.0, "multiplier of the recorded pace");
+DEFINE_int32(rate, 0, "open loop rate in commands/s over all threads, overrides speed");
+DEFINE_int32(timeout_ms, 2000, "redis timeout in milliseconds");
+
+namespace {
+
+using tis::RedisProxy;
+using tis::TraceReader;
+using tis::TraceRecord;
+using tis::TrafficRecorder;
+
+static const uint32_t MAX_VALUE_SIZE = 1024 * 1024;
+static const int32_t RANGE_STOP = 99;
+
+// returns true when the request itself went through
+typedef bool (*ReplayFunc)(RedisProxy* proxy,
+                const char* key,
+                const char* value,
+                uint32_t size);
+
+bool replay_ping(RedisProxy* proxy, const char*, const char*, uint32_t) {
+    return proxy->is_alive();
+}
+
+bool replay_set(RedisProxy* proxy, const char* key, const char* value, uint32_t size) {
+    return RedisProxy::REDIS_SET_OK == proxy->set(key, value, size);
+}
+
+bool replay_get(RedisProxy* proxy, const char* key, const char*, uint32_t) {
+    std::string value;
+    return RedisProxy::REDIS_GET_ERR != proxy->get(key, value);
+}
+
+bool replay_del(RedisProxy* proxy, const char* key, const char*, uint32_t) {
+    return RedisProxy::REDIS_DEL_ERR != proxy->del(key);
+}
+
+bool replay_exists(RedisProxy* proxy, const char* key, const char*, uint32_t) {
+    return RedisProxy::REDIS_EXISTS_ERR != proxy->exists(key);
+}
+
+bool replay_setex(RedisProxy* proxy, const char* key, const char* value, uint32_t size) {
+    return RedisProxy::REDIS_SETEX_OK == proxy->setex(key, value, size, 3600);
+}
+
+bool replay_incr(RedisProxy* proxy, const char* key, const char*, uint32_t) {
+    return RedisProxy::REDIS_INCR_OK == proxy->incr(key, NULL);
+}
+
+bool replay_lpush(RedisProxy* proxy, const char* key, const char* value, uint32_t size) {
+    return RedisProxy::REDIS_LPUSH_OK == proxy->lpush(key, value, size);
+}
+
+bool replay_rpush(RedisProxy* proxy, const char* key, const char* value, uint32_t size) {
+    return RedisProxy::REDIS_RPUSH_OK == proxy->rpush(key, value, size);
+}
+
+bool replay_smembers(RedisProxy* proxy, const char* key, const char*, uint32_t) {
+    std::vector<std::string> values;
+    return RedisProxy::REDIS_SMEMBERS_OK == proxy->smembers(key, &values);
+}
+
+bool replay_sadd(RedisProxy* proxy, const char* key, const char* value, uint32_t size) {
+    return RedisProxy::REDIS_SADD_OK == proxy->sadd(key, value, size);
+}
+
+bool replay_srem(RedisProxy* proxy, const char* key, const char* value, uint32_t size) {
+    return RedisProxy::REDIS_SREM_OK == proxy->srem(key, value, size);
+}
+
+bool replay_ltrim(RedisProxy* proxy, const char* key, const char*, uint32_t) {
+    return RedisProxy::REDIS_LTRIM_OK == proxy->ltrim(key, 0, -1);
+}
+
+bool replay_lrange(RedisProxy* proxy, const char* key, const char*, uint32_t) {
+    std::vector<std::string> values;
+    return RedisProxy::REDIS_LRANGE_OK == proxy->lrange(key, 0, RANGE_STOP, &values);
+}
+
+bool replay_hget(RedisProxy* proxy, const char* key, const char*, uint32_t) {
+    std::string value;
+    return RedisProxy::REDIS_HGET_ERR != proxy->hget(key, "field", value);
+}
+
+bool replay_zcard(RedisProxy* proxy, const char* key, const char*, uint32_t) {
+    uint64_t len = 0;
+    return RedisProxy::REDIS_ZCARD_OK == proxy->zcard(key, &len);
+}
+
+bool replay_zadd(RedisProxy* proxy, const char* key, const char* value, uint32_t size) {
+    return RedisProxy::REDIS_ZADD_OK == proxy->zadd(key, value, size);
+}
+
+bool replay_zincr(RedisProxy* proxy, const char* key, const char* value, uint32_t size) {
+    return RedisProxy::REDIS_ZINCR_OK == proxy->zincr(key, value, size, 1);
+}
+
+bool replay_zscore(RedisProxy* proxy, const char* key, const char* value, uint32_t size) {
+    std::string score;
+    return RedisProxy::REDIS_ZSCORE_ERR != proxy->zscore(key, value, size, score);
+}
+
+bool replay_zrem(RedisProxy* proxy, const char* key, const char* value, uint32_t size) {
+    return RedisProxy::REDIS_ZREM_OK == proxy->zrem(key, value, size);
+}
+
+bool replay_zrange(RedisProxy* proxy, const char* key, const char*, uint32_t) {
+    std::vector<std::string> values;
+    return RedisProxy::REDIS_ZRANGE_OK == proxy->zrange(key, 0, RANGE_STOP, &values);
+}
+
+bool replay_zremrangebyrank(RedisProxy* proxy, const char* key, const char*, uint32_t) {
+    return RedisProxy::REDIS_ZREMRANGEBYRANK_OK == proxy->zremrangebyrank(key, 0, 0);
+}
+
+// blocking pops are replayed without blocking, an idle consumer is not load
+bool replay_lmpop(RedisProxy* proxy, const char* key, const char*, uint32_t) {
+    std::vector<std::string> values;
+    return RedisProxy::REDIS_LMPOP_ERR != proxy->lmpop(key, 1, &values);
+}
+
+bool replay_lmove(RedisProxy* proxy, const char* key, const char*, uint32_t) {
+    std::string value;
+    return RedisProxy::REDIS_LMOVE_ERR != proxy->lmove(key, key, value);
+}
+
+bool replay_lrem(RedisProxy* proxy, const char* key, const char* value, uint32_t size) {
+    return RedisProxy::REDIS_LREM_OK == proxy->lrem(key, value, size);
+}
+
+struct ReplayEntry {
+    const char* command;
+    ReplayFunc func;
+};
+
+const ReplayEntry REPLAY_ENTRIES[] = {
+    {"PING", replay_ping},
+    {"SET", replay_set},
+    {"GET", replay_get},
+    {"DEL", replay_del},
+    {"EXISTS", replay_exists},
+    {"SETEX", replay_setex},
+    {"INCR", replay_incr},
+    {"LPUSH", replay_lpush},
+    {"RPUSH", replay_rpush},
+    {"SMEMBERS", replay_smembers},
+    {"SADD", replay_sadd},
+    {"SREM", replay_srem},
+    {"LTRIM", replay_ltrim},
+    {"LRANGE", replay_lrange},
+    {"HGET", replay_hget},
+    {"ZCARD", replay_zcard},
+    {"ZADD", replay_zadd},
+    {"ZINCRBY", replay_zincr},
+    {"ZSCORE", replay_zscore},
+    {"ZREM", replay_zrem},
+    {"ZRANGE", replay_zrange},
+    {"ZREMRANGEBYRANK", replay_zremrangebyrank},
+    {"LMPOP", replay_lmpop},
+    {"BLMPOP", replay_lmpop},
+    {"LMOVE", replay_lmove},
+    {"BLMOVE", replay_lmove},
+    {"LREM", replay_lrem},
+};
+
+ReplayFunc g_replay_funcs[256];
+std::string g_value;
+
+struct ReplayThread {
+    pthread_t tid;
+    uint32_t index;
+    const TraceReader* reader;
+    uint64_t start_us;
+    uint64_t first_timestamp_us;
+    uint64_t sent_num;
+    uint64_t err_num;
+    uint64_t skip_num;
+    uint64_t late_num;
+    std::vector<uint32_t> service_us;
+    std::vector<uint32_t> response_us;
+};
+
+// usleep() takes at most a second
+void sleep_us(uint64_t us) {
+    struct timespec ts;
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+    while (0 != nanosleep(&ts, &ts) && EINTR == errno) {
+    }
+}
+
+void* replay_thread(void* arg) {
+    ReplayThread* ctx = static_cast<ReplayThread*>(arg);
+    RedisProxy proxy;
+    proxy.set_timeout(FLAGS_timeout_ms);
+    if (0 != proxy.connect(FLAGS_host.c_str(), FLAGS_port)) {
+        LOG(WARNING) << "redis replay: connect failed, thread[" << ctx->index << "]";
+        return NULL;
+    }
+    // own records only; with recorded pacing they are replayed in timestamp order, as
+    // the trace is in completion order and not sorted by start time. the timestamp is
+    // copied out, a trace still being written may overwrite the record meanwhile
+    std::vector<std::pair<uint64_t, uint64_t> > indexes;
+    for (uint64_t i = 0; i < ctx->reader->size(); ++i) {
+        const TraceRecord* record = ctx->reader->get(i);
+        if (NULL != record && ctx->index == record->key_hash % FLAGS_thread_num) {
+            indexes.push_back(std::make_pair(record->timestamp_us, i));
+        }
+    }
+    if (FLAGS_rate <= 0) {
+        // ties keep the trace order, as the index is the second key
+        std::sort(indexes.begin(), indexes.end());
+    }
+    char key_buf[64];
+    for (size_t n = 0; n < indexes.size(); ++n) {
+        uint64_t i = indexes[n].second;
+        const TraceRecord* record = ctx->reader->get(i);
+        if (NULL == record) {
+            continue;
+        }
+        ReplayFunc func = g_replay_funcs[record->command];
+        if (NULL == func) {
+            ++ctx->skip_num;
+            continue;
+        }
+        uint64_t due_us = ctx->start_us;
+        if (FLAGS_rate > 0) {
+            due_us += i * 1000000 / FLAGS_rate;
+        } else if (record->timestamp_us > ctx->first_timestamp_us) {
+            due_us += static_cast<uint64_t>((record->timestamp_us - ctx->first_timestamp_us)
+                                            / FLAGS_speed);
+        }
+        uint64_t now = tis::monotonic_time_us();
+        if (now < due_us) {
+            sleep_us(due_us - now);
+        } else if (now > due_us + 1000) {
+            ++ctx->late_num;
+        }
+        if (record->key_len > 0) {
+            memcpy(key_buf, record->key, record->key_len);
+            key_buf[record->key_len] = '\0';
+        } else {
+            snprintf(key_buf, sizeof(key_buf), "trace:%016llx",
+                    static_cast<unsigned long long>(record->key_hash));
+        }
+        uint32_t size = std::min(record->value_size, MAX_VALUE_SIZE);
+        uint64_t send_us = tis::monotonic_time_us();
+        if (!func(&proxy, key_buf, g_value.data(), size)) {
+            ++ctx->err_num;
+        }
+        uint64_t done_us = tis::monotonic_time_us();
+        ++ctx->sent_num;
+        ctx->service_us.push_back(done_us - send_us);
+        ctx->response_us.push_back(done_us > due_us ? done_us - due_us : 0);
+    }
+    return NULL;
+}
+
+uint32_t percentile(const std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1));
+    return sorted[index];
+}
+
+void report(const char* name, std::vector<uint32_t>* latencies) {
+    std::sort(latencies->begin(), latencies->end());
+    printf("%s us: p50[%u] p99[%u] p999[%u] max[%u]\n",
+            name,
+            percentile(*latencies, 0.5),
+            percentile(*latencies, 0.99),
+            percentile(*latencies, 0.999),
+            percentile(*latencies, 1.0));
+}
+
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    if (FLAGS_thread_num <= 0 || FLAGS_speed <= 0) {
+        fprintf(stderr, "illegal thread_num or speed\n");
+        return 1;
+    }
+    TraceReader reader;
+    if (0 != reader.open(FLAGS_trace_file.c_str())) {
+        fprintf(stderr, "open trace failed, file[%s]\n", FLAGS_trace_file.c_str());
+        return 1;
+    }
+    // records are written on completion, so the earliest start is not necessarily first
+    uint64_t first_timestamp_us = UINT64_MAX;
+    for (uint64_t i = 0; i < reader.size(); ++i) {
+        const TraceRecord* record = reader.get(i);
+        if (NULL != record && record->timestamp_us < first_timestamp_us) {
+            first_timestamp_us = record->timestamp_us;
+        }
+    }
+    memset(g_replay_funcs, 0, sizeof(g_replay_funcs));
+    for (size_t i = 0; i < sizeof(REPLAY_ENTRIES) / sizeof(REPLAY_ENTRIES[0]); ++i) {
+        const char* command = REPLAY_ENTRIES[i].command;
+        uint8_t code = TrafficRecorder::command_code(command, strlen(command));
+        g_replay_funcs[code] = REPLAY_ENTRIES[i].func;
+    }
+    g_replay_funcs[TrafficRecorder::COMMAND_UNKNOWN] = NULL;
+    g_value.assign(MAX_VALUE_SIZE, 'x');
+
+    std::vector<ReplayThread> threads(FLAGS_thread_num);
+    uint64_t start_us = tis::monotonic_time_us() + 100000;
+    for (int32_t i = 0; i < FLAGS_thread_num; ++i) {
+        ReplayThread& ctx = threads[i];
+        ctx.index = i;
+        ctx.reader = &reader;
+        ctx.start_us = start_us;
+        ctx.first_timestamp_us = first_timestamp_us;
+        ctx.sent_num = 0;
+        ctx.err_num = 0;
+        ctx.skip_num = 0;
+        ctx.late_num = 0;
+        if (0 != pthread_create(&ctx.tid, NULL, replay_thread, &ctx)) {
+            fprintf(stderr, "create thread failed\n");
+            return 1;
+        }
+    }
+    uint64_t sent_num = 0;
+    uint64_t err_num = 0;
+    uint64_t skip_num = 0;
+    uint64_t late_num = 0;
+    std::vector<uint32_t> service_us;
+    std::vector<uint32_t> response_us;
+    for (int32_t i = 0; i < FLAGS_thread_num; ++i) {
+        pthread_join(threads[i].tid, NULL);
+        sent_num += threads[i].sent_num;
+        err_num += threads[i].err_num;
+        skip_num += threads[i].skip_num;
+        late_num += threads[i].late_num;
+        service_us.insert(service_us.end(),
+                threads[i].service_us.begin(), threads[i].service_us.end());
+        response_us.insert(response_us.end(),
+                threads[i].response_us.begin(), threads[i].response_us.end());
+    }
+    uint64_t now = tis::monotonic_time_us();
+    double elapsed = (now > start_us) ? (now - start_us) / 1000000.0 : 0.001;
+    printf("trace[%s] records[%llu] sent[%llu] err[%llu] skip[%llu] late[%llu]\n",
+            FLAGS_trace_file.c_str(),
+            static_cast<unsigned long long>(reader.size()),
+            static_cast<unsigned long long>(sent_num),
+            static_cast<unsigned long long>(err_num),
+            static_cast<unsigned long long>(skip_num),
+            static_cast<unsigned long long>(late_num));
+    printf("elapsed[%.3fs] qps[%.0f]\n", elapsed, sent_num / elapsed);
+    report("service", &service_us);
+    report("response", &response_us);
+    return 0;
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
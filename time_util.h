@@ -0,0 +1,37 @@
+
+/**
+ * @file time_util.h
+ * @author way
+ * @date 2026/10/18 23:12:40
+ * @brief clocks in microseconds: wall clock for timestamps, monotonic for durations
+ *
+ **/
+
+#ifndef  __TIME_UTIL_H_
+#define  __TIME_UTIL_H_
+
+#include <stdint.h>
+#include <sys/time.h>
+#include <time.h>
+
+namespace tis {
+
+// comparable across processes, but may step back or forth when the clock is set
+inline uint64_t wall_time_us() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+// never steps back, use it for elapsed time and latency
+inline uint64_t monotonic_time_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+}
+
+#endif  //__TIME_UTIL_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,297 @@
+ 
+/**
+ * @file traffic_recorder.cpp
+ * @author way
+ * @date 2026/10/18 16:52:08
+ * @brief
+ *
+ **/
+
+#include "traffic_recorder.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "glog/logging.h"
+#include "hot_key_detector.h"
+#include "time_util.h"
+
+namespace tis {
+
+// index is the command code, keep appending, codes are stored in trace files
+static const char* const COMMAND_NAMES[] = {
+    "UNKNOWN",
+    "PING",
+    "SET",
+    "GET",
+    "DEL",
+    "EXISTS",
+    "SETEX",
+    "INCR",
+    "LPUSH",
+    "RPUSH",
+    "SMEMBERS",
+    "SADD",
+    "SREM",
+    "LTRIM",
+    "LRANGE",
+    "HGET",
+    "ZCARD",
+    "ZADD",
+    "ZINCRBY",
+    "ZSCORE",
+    "ZREM",
+    "ZRANGE",
+    "ZREMRANGEBYRANK",
+    "LMPOP",
+    "BLMPOP",
+    "LMOVE",
+    "BLMOVE",
+    "LREM",
+    "LLEN",
+    "HINCRBY",
+    "HDEL",
+};
+
+static const uint8_t COMMAND_NUM = sizeof(COMMAND_NAMES) / sizeof(COMMAND_NAMES[0]);
+
+static uint32_t hash_command(const char* command, size_t len) {
+    uint32_t h = 2166136261U;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= static_cast<unsigned char>(toupper(command[i]));
+        h *= 16777619U;
+    }
+    return h;
+}
+
+// open addressing table from name to code, built on first use so that it also works
+// for callers running before main
+static const uint32_t COMMAND_TABLE_SIZE = 128;
+static uint8_t g_command_table[COMMAND_TABLE_SIZE];
+static pthread_once_t g_command_table_once = PTHREAD_ONCE_INIT;
+
+static void build_command_table() {
+    for (uint8_t i = 1; i < COMMAND_NUM; ++i) {
+        uint32_t slot = hash_command(COMMAND_NAMES[i], strlen(COMMAND_NAMES[i]))
+            % COMMAND_TABLE_SIZE;
+        while (0 != g_command_table[slot]) {
+            slot = (slot + 1) % COMMAND_TABLE_SIZE;
+        }
+        g_command_table[slot] = i;
+    }
+}
+
+TrafficRecorder::TrafficRecorder() {
+    _fd = -1;
+    _map_size = 0;
+    _record_keys = true;
+    _header = NULL;
+    _records = NULL;
+    _dropped_num = 0;
+}
+
+TrafficRecorder::~TrafficRecorder() {
+    close();
+}
+
+uint8_t TrafficRecorder::command_code(const char* command, size_t len) {
+    pthread_once(&g_command_table_once, build_command_table);
+    uint32_t slot = hash_command(command, len) % COMMAND_TABLE_SIZE;
+    for (uint8_t code = g_command_table[slot]; 0 != code; code = g_command_table[slot]) {
+        const char* name = COMMAND_NAMES[code];
+        if (0 == strncasecmp(command, name, len) && '\0' == name[len]) {
+            return code;
+        }
+        slot = (slot + 1) % COMMAND_TABLE_SIZE;
+    }
+    return COMMAND_UNKNOWN;
+}
+
+const char* TrafficRecorder::command_name(uint8_t code) {
+    return (code < COMMAND_NUM) ? COMMAND_NAMES[code] : COMMAND_NAMES[COMMAND_UNKNOWN];
+}
+
+int TrafficRecorder::open(const char* path, uint64_t capacity, bool wrap, bool record_keys) {
+    if (NULL == path || 0 == capacity) {
+        LOG(WARNING) << "traffic recorder: illegal param";
+        return 1;
+    }
+    if (NULL != _header) {
+        LOG(WARNING) << "traffic recorder: already opened";
+        return 1;
+    }
+    _fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (_fd < 0) {
+        LOG(WARNING) << "traffic recorder: open failed, path[" << path
+            << "] errno[" << errno << "]";
+        return 1;
+    }
+    _map_size = sizeof(TraceHeader) + capacity * sizeof(TraceRecord);
+    if (0 != ftruncate(_fd, _map_size)) {
+        LOG(WARNING) << "traffic recorder: truncate failed, path[" << path
+            << "] size[" << _map_size << "] errno[" << errno << "]";
+        close();
+        return 1;
+    }
+    void* addr = mmap(NULL, _map_size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (MAP_FAILED == addr) {
+        LOG(WARNING) << "traffic recorder: mmap failed, path[" << path
+            << "] errno[" << errno << "]";
+        close();
+        return 1;
+    }
+    TraceHeader* header = static_cast<TraceHeader*>(addr);
+    header->magic = TRACE_MAGIC;
+    header->version = TRACE_VERSION;
+    header->record_size = sizeof(TraceRecord);
+    header->wrap = wrap ? 1 : 0;
+    header->capacity = capacity;
+    header->start_us = wall_time_us();
+    header->next_seq = 0;
+    _records = reinterpret_cast<TraceRecord*>(header + 1);
+    _record_keys = record_keys;
+    _dropped_num = 0;
+    __sync_synchronize();
+    _header = header;
+    return 0;
+}
+
+void TrafficRecorder::close() {
+    if (NULL != _header) {
+        munmap(_header, _map_size);
+        _header = NULL;
+        _records = NULL;
+    }
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+void TrafficRecorder::record(uint8_t command,
+                            const char* key,
+                            uint32_t value_size,
+                            uint64_t start_us,
+                            uint32_t latency_us,
+                            int result) {
+    TraceHeader* header = _header;
+    if (NULL == header) {
+        return;
+    }
+    uint64_t seq = __sync_fetch_and_add(&header->next_seq, 1);
+    if (!header->wrap && seq >= header->capacity) {
+        __sync_fetch_and_add(&_dropped_num, 1);
+        return;
+    }
+    TraceRecord* record = &_records[seq % header->capacity];
+    record->seq = 0;
+    __sync_synchronize();
+    record->timestamp_us = start_us;
+    record->latency_us = latency_us;
+    record->value_size = value_size;
+    record->result = static_cast<int8_t>(result);
+    record->command = command;
+    record->key_len = 0;
+    if (NULL != key) {
+        size_t key_len = strlen(key);
+        record->key_hash = HotKeyDetector::hash_key(key, key_len);
+        if (_record_keys && key_len <= TRACE_MAX_KEY_LEN) {
+            memcpy(record->key, key, key_len);
+            record->key_len = key_len;
+        }
+    } else {
+        record->key_hash = 0;
+    }
+    __sync_synchronize();
+    record->seq = seq + 1;
+}
+
+TraceReader::TraceReader() {
+    _fd = -1;
+    _map_size = 0;
+    _header = NULL;
+    _records = NULL;
+    _first_seq = 0;
+    _size = 0;
+}
+
+TraceReader::~TraceReader() {
+    close();
+}
+
+int TraceReader::open(const char* path) {
+    if (NULL == path || NULL != _header) {
+        return 1;
+    }
+    _fd = ::open(path, O_RDONLY);
+    if (_fd < 0) {
+        LOG(WARNING) << "trace reader: open failed, path[" << path << "] errno[" << errno << "]";
+        return 1;
+    }
+    struct stat st;
+    if (0 != fstat(_fd, &st) || static_cast<size_t>(st.st_size) < sizeof(TraceHeader)) {
+        LOG(WARNING) << "trace reader: illegal file, path[" << path << "]";
+        close();
+        return 1;
+    }
+    _map_size = st.st_size;
+    void* addr = mmap(NULL, _map_size, PROT_READ, MAP_SHARED, _fd, 0);
+    if (MAP_FAILED == addr) {
+        LOG(WARNING) << "trace reader: mmap failed, path[" << path << "] errno[" << errno << "]";
+        close();
+        return 1;
+    }
+    _header = static_cast<const TraceHeader*>(addr);
+    if (TRACE_MAGIC != _header->magic
+            || TRACE_VERSION != _header->version
+            || sizeof(TraceRecord) != _header->record_size
+            || _map_size < sizeof(TraceHeader) + _header->capacity * sizeof(TraceRecord)) {
+        LOG(WARNING) << "trace reader: illegal header, path[" << path << "]";
+        close();
+        return 1;
+    }
+    _records = reinterpret_cast<const TraceRecord*>(_header + 1);
+    uint64_t next_seq = _header->next_seq;
+    if (next_seq > _header->capacity) {
+        _first_seq = _header->wrap ? next_seq - _header->capacity : 0;
+        _size = _header->capacity;
+    } else {
+        _first_seq = 0;
+        _size = next_seq;
+    }
+    return 0;
+}
+
+void TraceReader::close() {
+    if (NULL != _header) {
+        munmap(const_cast<TraceHeader*>(_header), _map_size);
+        _header = NULL;
+        _records = NULL;
+    }
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+    _first_seq = 0;
+    _size = 0;
+}
+
+const TraceRecord* TraceReader::get(uint64_t index) const {
+    if (index >= _size) {
+        return NULL;
+    }
+    uint64_t seq = _first_seq + index;
+    const TraceRecord* record = &_records[seq % _header->capacity];
+    return (seq + 1 == record->seq) ? record : NULL;
+}
+
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,116 @@
+ 
+/**
+ * @file traffic_recorder.h
+ * @author way
+ * @date 2026/10/18 16:20:33
+ * @brief binary command trace in a memory mapped file, written lock free by any number
+ *        of RedisProxy instances and read back by redis_replay
+ *
+ **/
+
+#ifndef  __TRAFFIC_RECORDER_H_
+#define  __TRAFFIC_RECORDER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace tis {
+
+static const uint32_t TRACE_MAGIC = 0x45435254;    // "TRCE"
+static const uint16_t TRACE_VERSION = 1;
+static const uint32_t TRACE_MAX_KEY_LEN = 28;
+
+struct TraceHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t wrap;              // ring mode, oldest records are overwritten
+    uint32_t reserved;
+    uint64_t capacity;          // in records
+    uint64_t start_us;
+    volatile uint64_t next_seq; // slots handed out so far, may run past capacity
+    char padding[24];
+};
+
+struct TraceRecord {
+    volatile uint64_t seq;      // 1 based, 0 while the slot is being written
+    uint64_t timestamp_us;      // wall clock at the start of the command
+    uint64_t key_hash;          // HotKeyDetector::hash_key
+    uint32_t latency_us;        // monotonic clock
+    uint32_t value_size;
+    int8_t result;              // RedisProxy::REDIS_RETURN_*
+    uint8_t command;            // TrafficRecorder::command_code
+    uint8_t key_len;            // 0 if only the hash is kept
+    uint8_t reserved;
+    char key[TRACE_MAX_KEY_LEN];
+};
+
+class TrafficRecorder {
+public:
+    static const uint64_t DEFAULT_CAPACITY = 1 << 24;    // 1G file
+    static const uint8_t COMMAND_UNKNOWN = 0;
+public:
+    TrafficRecorder();
+    virtual ~TrafficRecorder();
+    // keys longer than TRACE_MAX_KEY_LEN, or all keys when record_keys is false, are
+    // kept as hash only
+    int open(const char* path,
+                uint64_t capacity = DEFAULT_CAPACITY,
+                bool wrap = false,
+                bool record_keys = true);
+    // detach it from every proxy first
+    void close();
+    // command is a command_code(), looked up once per call site by the caller
+    void record(uint8_t command,
+                const char* key,
+                uint32_t value_size,
+                uint64_t start_us,
+                uint32_t latency_us,
+                int result);
+    uint64_t get_dropped_num() const { return _dropped_num; }
+
+    // command is the command name in any case, not necessarily NUL terminated
+    static uint8_t command_code(const char* command, size_t len);
+    static const char* command_name(uint8_t code);
+
+private:
+    int _fd;
+    size_t _map_size;
+    bool _record_keys;
+    TraceHeader* _header;
+    TraceRecord* _records;
+    volatile uint64_t _dropped_num;
+
+    TrafficRecorder(const TrafficRecorder&);
+    TrafficRecorder& operator=(const TrafficRecorder&);
+};
+
+class TraceReader {
+public:
+    TraceReader();
+    virtual ~TraceReader();
+    int open(const char* path);
+    void close();
+    // records in write order
+    uint64_t size() const { return _size; }
+    // NULL for a slot that was not completely written
+    const TraceRecord* get(uint64_t index) const;
+    const TraceHeader* get_header() const { return _header; }
+
+private:
+    int _fd;
+    size_t _map_size;
+    const TraceHeader* _header;
+    const TraceRecord* _records;
+    uint64_t _first_seq;
+    uint64_t _size;
+
+    TraceReader(const TraceReader&);
+    TraceReader& operator=(const TraceReader&);
+};
+
+}
+
+#endif  //__TRAFFIC_RECORDER_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */